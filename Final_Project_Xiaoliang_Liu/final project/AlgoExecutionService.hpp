@@ -11,13 +11,13 @@
 
 using namespace std;
 
-template <class T>
-class AlgoExecutionService : public Service<string, ExecutionOrder<T>>
+template <class T, class Chain = ListenerChain<ExecutionOrder<T> > >
+class AlgoExecutionService : public Service<string, ExecutionOrder<T>, Chain>
 {
 private:
     map<string, ExecutionOrder<T>> execution_orders;
     int counter;
-    double spread_tol;
+    TickPrice spread_tol;
 
 public:
 
@@ -27,70 +27,92 @@ public:
 
     void OnMessage(ExecutionOrder<T>& data);
 
-    void ExecuteOrder(OrderBook<T>& data);
+    void ExecuteOrder(const OrderBook<T>& data);
+
+    void ExecuteOrderBatch(vector<OrderBook<T> >& data);
+
+private:
+    // Build an execution order from a book, returns false if the spread is too tight to trade
+    bool MakeOrder(const OrderBook<T>& data, ExecutionOrder<T>& execu_order);
 };
 
-template <typename T>
-AlgoExecutionService<T>::AlgoExecutionService() : counter(0), spread_tol(1.0 / 128)
+template <typename T, typename Chain>
+AlgoExecutionService<T, Chain>::AlgoExecutionService() : counter(0), spread_tol(TICKS_PER_POINT / 128)
 {
     execution_orders = map<string, ExecutionOrder<T>>();
 }
 
-template <typename T>
-ExecutionOrder<T>& AlgoExecutionService<T>::GetData(string key)
+template <typename T, typename Chain>
+ExecutionOrder<T>& AlgoExecutionService<T, Chain>::GetData(string key)
 {
     return execution_orders[key];
 }
 
-template <typename T>
-void AlgoExecutionService<T>::OnMessage(ExecutionOrder<T>& data)
+template <typename T, typename Chain>
+void AlgoExecutionService<T, Chain>::OnMessage(ExecutionOrder<T>& data)
 {
     execution_orders[data.GetOrderId()] = data;
 }
 
-template <typename T>
-void AlgoExecutionService<T>::ExecuteOrder(OrderBook<T>& data)
+template <typename T, typename Chain>
+void AlgoExecutionService<T, Chain>::ExecuteOrder(const OrderBook<T>& data)
 {
-    T product = data.GetProduct();
-    vector<Order> bid_stack = data.GetBidStack();
-    vector<Order> offer_stack = data.GetOfferStack();
-    Order best_bid = bid_stack.empty() ? Order() : bid_stack[0];
-    Order best_offer = offer_stack.empty() ? Order() : offer_stack[0];
+    ExecutionOrder<T> execu_order;
+    if (MakeOrder(data, execu_order))
+        Service<string, ExecutionOrder<T>, Chain>::Notify(execu_order);
+}
 
-    for (const auto& e : bid_stack)
-    {
-        if (e.GetPrice() > best_bid.GetPrice())
-            best_bid = e;
-    }
-    for (const auto& e : offer_stack)
+template <typename T, typename Chain>
+void AlgoExecutionService<T, Chain>::ExecuteOrderBatch(vector<OrderBook<T> >& data)
+{
+    vector<ExecutionOrder<T> > orders;
+    ExecutionOrder<T> execu_order;
+    for (auto& e : data)
     {
-        if (e.GetPrice() < best_offer.GetPrice())
-            best_offer = e;
+        if (MakeOrder(e, execu_order))
+            orders.push_back(execu_order);
     }
+    if (!orders.empty())
+        Service<string, ExecutionOrder<T>, Chain>::NotifyBatch(orders);
+}
+
+template <typename T, typename Chain>
+bool AlgoExecutionService<T, Chain>::MakeOrder(const OrderBook<T>& data, ExecutionOrder<T>& execu_order)
+{
+    const T& product = data.GetProduct();
+    if (data.GetBidDepth() == 0 || data.GetOfferDepth() == 0)
+        return false;
+
+    // the book tracks its best levels, nothing is scanned here
+    size_t best_bid = data.GetBestBidLevel();
+    size_t best_offer = data.GetBestOfferLevel();
 
-    double price, quantity;
+    TickPrice price;
+    double quantity;
     PricingSide side;
-    if (!bid_stack.empty() && !offer_stack.empty() && (best_offer.GetPrice() - best_bid.GetPrice() > spread_tol))
+    if (data.GetOfferPrice(best_offer) - data.GetBidPrice(best_bid) > spread_tol)
     {
         if (counter % 2 == 0) // bid order
         {
-            price = best_bid.GetPrice();
-            quantity = best_bid.GetQuantity();
+            price = data.GetBidPrice(best_bid);
+            quantity = data.GetBidQuantity(best_bid);
             side = BID;
         }
         else // offer order
         {
-            price = best_offer.GetPrice();
-            quantity = best_offer.GetQuantity();
+            price = data.GetOfferPrice(best_offer);
+            quantity = data.GetOfferQuantity(best_offer);
             side = OFFER;
         }
 
         string tradeID = "TRADEID_" + to_string(counter);
-        ExecutionOrder<T> execu_order(product, side, tradeID, MARKET, price, quantity, 2 * quantity, "", false);
+        // route to the venue quoting the book the order was priced from
+        execu_order = ExecutionOrder<T>(product, side, tradeID, MARKET, price, quantity, 2 * quantity, "", false, data.GetVenue());
         execution_orders[execu_order.GetOrderId()] = execu_order;
         ++counter;
-        Service<string, ExecutionOrder<T>>::Notify(execu_order);
+        return true;
     }
+    return false;
 }
 
 #endif
@@ -9,11 +9,11 @@
 #include "PricingService.hpp"
 #include "StreamingService.hpp"
 
-template <class V>
-class AlgoStreamingService : public Service<string, PriceStream<V>>
+template <class V, class Chain = ListenerChain<PriceStream<V> > >
+class AlgoStreamingService : public Service<string, PriceStream<V>, Chain>
 {
 private:
-    map<string, PriceStream<V>> pricestreams;
+    ProductTable<PriceStream<V> > pricestreams;
     random_device rd; // Random device for generating random numbers
     default_random_engine generator{ rd() }; // Random number generator
 
@@ -21,39 +21,72 @@ public:
     // Get data on our service given a key
     PriceStream<V>& GetData(string key);
 
+    // Get data on our service given a product index
+    PriceStream<V>& GetData(int productIndex);
+
     // The callback that a Connector should invoke for any new or updated data
     void OnMessage(PriceStream<V>& data);
 
     // Publish two-way prices
     void PublishPrice(Price<V>& data);
+
+    // Publish two-way prices for a block of prices
+    void PublishPriceBatch(vector<Price<V> >& data);
+
+private:
+    // Build the two-way price stream for a price
+    PriceStream<V> MakePriceStream(Price<V>& data);
 };
 
-template <typename V>
-PriceStream<V>& AlgoStreamingService<V>::GetData(string key)
+template <typename V, typename Chain>
+PriceStream<V>& AlgoStreamingService<V, Chain>::GetData(string key)
 {
     return pricestreams[key];
 }
 
-template <typename V>
-void AlgoStreamingService<V>::OnMessage(PriceStream<V>& data)
+template <typename V, typename Chain>
+PriceStream<V>& AlgoStreamingService<V, Chain>::GetData(int productIndex)
+{
+    return pricestreams[productIndex];
+}
+
+template <typename V, typename Chain>
+void AlgoStreamingService<V, Chain>::OnMessage(PriceStream<V>& data)
 {
-    pricestreams[data.GetProduct().GetProductId()] = data;
+    pricestreams[data.GetProduct().GetProductIndex()] = data;
 }
 
-template <typename V>
-void AlgoStreamingService<V>::PublishPrice(Price<V>& data)
+template <typename V, typename Chain>
+void AlgoStreamingService<V, Chain>::PublishPrice(Price<V>& data)
 {
-    V product = data.GetProduct();
-    double bid_price = data.GetMid() - data.GetBidOfferSpread() / 2;
-    double ask_price = data.GetMid() + data.GetBidOfferSpread() / 2;
+    PriceStream<V> price_stream = MakePriceStream(data);
+    pricestreams[price_stream.GetProduct().GetProductIndex()] = price_stream;
+    Service<string, PriceStream<V>, Chain>::Notify(price_stream);
+}
+
+template <typename V, typename Chain>
+void AlgoStreamingService<V, Chain>::PublishPriceBatch(vector<Price<V> >& data)
+{
+    vector<PriceStream<V> > price_streams;
+    price_streams.reserve(data.size());
+    for (auto& e : data)
+    {
+        price_streams.push_back(MakePriceStream(e));
+        pricestreams[e.GetProduct().GetProductIndex()] = price_streams.back();
+    }
+    Service<string, PriceStream<V>, Chain>::NotifyBatch(price_streams);
+}
+
+template <typename V, typename Chain>
+PriceStream<V> AlgoStreamingService<V, Chain>::MakePriceStream(Price<V>& data)
+{
+    TickPrice bid_price = data.GetBid();
+    TickPrice ask_price = data.GetOffer();
     uniform_int_distribution<long> distribution(1000000, 1999999);
     long visible_size = distribution(generator); // Generating random visible size
     PriceStreamOrder bid_order(bid_price, visible_size, 2 * visible_size, BID);
     PriceStreamOrder ask_order(ask_price, visible_size, 2 * visible_size, OFFER);
-    PriceStream<V> price_stream(data.GetProduct(), bid_order, ask_order);
-
-    pricestreams[price_stream.GetProduct().GetProductId()] = price_stream;
-    Service<string, PriceStream<V>>::Notify(price_stream);
+    return PriceStream<V>(data.GetProduct(), bid_order, ask_order);
 }
 
 #endif
@@ -0,0 +1,440 @@
+
+#ifndef ASYNC_SERVICE_LISTENER_HPP
+#define ASYNC_SERVICE_LISTENER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "SOA.hpp"
+
+using namespace std;
+
+// What a producer does when the ring is full
+enum OverflowPolicy { BLOCK, DROP, CONFLATE };
+
+
+/**
+ * Bounded lock-free single-producer/single-consumer ring buffer.
+ * The capacity is rounded up to a power of two.
+ * Type T is the element type.
+ */
+template<typename T>
+class SPSCRing
+{
+public:
+    // ctor for a ring
+    SPSCRing(size_t _capacity);
+
+    // Push an element, returns false if the ring is full (producer side)
+    bool TryPush(const T& item);
+
+    // Pop an element, returns false if the ring is empty (consumer side)
+    bool TryPop(T& item);
+
+    // Get the number of elements in the ring
+    size_t Size() const;
+
+    // Get the capacity of the ring
+    size_t Capacity() const;
+
+private:
+    vector<T> slots;
+    size_t mask;
+    alignas(64) atomic<size_t> head;    // next slot to read, written by the consumer
+    alignas(64) atomic<size_t> tail;    // next slot to write, written by the producer
+};
+
+
+/**
+ * Listener adapter that queues events on an SPSCRing and hands them to the wrapped
+ * listener on a dedicated consumer thread, so a slow listener does not stall the
+ * notifying service. Events are copied into the ring, and runs of add events are handed to
+ * the wrapped listener through ProcessAddBatch().
+ * Under CONFLATE, events that overflow the ring wait in a slot per product, where a newer event
+ * of the same product overwrites them; products are queued in the order they overflowed. New
+ * events keep going to the slots until they have all moved to the ring, and the consumer takes
+ * them itself once the ring drains, so they are delivered while the producer is idle too.
+ * CONFLATE needs events with GetProduct().
+ * Must be fed by a single producer thread, i.e. one notifying service.
+ * Type V is the event type.
+ */
+template<typename V>
+class AsyncServiceListener : public ServiceListener<V>
+{
+public:
+    // ctor, starts the consumer thread
+    AsyncServiceListener(ServiceListener<V>* _listener, size_t _capacity = 65536, OverflowPolicy _policy = BLOCK);
+    ~AsyncServiceListener();
+
+    // Listener callback to process an add event to the Service
+    void ProcessAdd(V& data);
+
+    // Listener callback to process a remove event to the Service
+    void ProcessRemove(V& data);
+
+    // Listener callback to process an update event to the Service
+    void ProcessUpdate(V& data);
+
+    // Drain the queue and stop the consumer thread
+    void Stop();
+
+    // Get the number of queued events
+    size_t GetQueueDepth() const;
+
+    // Get the highest queue depth seen by the producer
+    size_t GetMaxQueueDepth() const;
+
+    // Get the number of events dropped under the DROP policy
+    long GetDropped() const;
+
+    // Get the number of events overwritten under the CONFLATE policy
+    long GetConflated() const;
+
+    // Get the number of events handed to the wrapped listener
+    long GetProcessed() const;
+
+private:
+    enum EventType { ADD_EVENT, REMOVE_EVENT, UPDATE_EVENT };
+
+    struct Event
+    {
+        EventType type;
+        V data;
+    };
+
+    struct Slot
+    {
+        Event event;
+        bool pending = false;
+    };
+
+    ServiceListener<V>* listener;
+    OverflowPolicy policy;
+    SPSCRing<Event> ring;
+    mutex pending_mutex;        // guards slots and pending_products, CONFLATE after an overflow only
+    vector<Slot> slots;         // latest overflowed event of each product
+    deque<int> pending_products;    // products with an overflowed event, in the order they overflowed
+    atomic<bool> has_pending;   // pending_products is not empty
+    atomic<size_t> max_depth;
+    atomic<long> dropped;
+    atomic<long> conflated;
+    atomic<long> processed;
+    atomic<bool> running;
+    thread consumer;
+
+    // Put an event on the ring according to the overflow policy
+    void Enqueue(EventType type, V& data);
+
+    // Push an event, waiting for the consumer while the ring is full
+    void PushBlocking(const Event& e);
+
+    // Move overflowed events to the ring while it has room, pending_mutex must be held
+    void FlushPending();
+
+    // Keep an overflowed event in its product's slot, pending_mutex must be held
+    void PutPending(Event& e);
+
+    // Take the overflowed events once the ring is empty, false if there were none (consumer side)
+    bool TakePending(vector<Event>& events);
+
+    // Hand an event to the wrapped listener, batching runs of add events
+    void Dispatch(Event& e, vector<V>& batch);
+
+    // Hand a batch of add events to the wrapped listener
+    void DispatchBatch(vector<V>& batch);
+
+    // Consumer thread loop
+    void Consume();
+};
+
+
+template<typename T>
+SPSCRing<T>::SPSCRing(size_t _capacity) : head(0), tail(0)
+{
+    size_t capacity = 1;
+    while (capacity < _capacity)
+        capacity <<= 1;
+    slots.resize(capacity);
+    mask = capacity - 1;
+}
+
+template<typename T>
+bool SPSCRing<T>::TryPush(const T& item)
+{
+    size_t t = tail.load(memory_order_relaxed);
+    if (t - head.load(memory_order_acquire) > mask)
+        return false;
+    slots[t & mask] = item;
+    tail.store(t + 1, memory_order_release);
+    return true;
+}
+
+template<typename T>
+bool SPSCRing<T>::TryPop(T& item)
+{
+    size_t h = head.load(memory_order_relaxed);
+    if (h == tail.load(memory_order_acquire))
+        return false;
+    item = slots[h & mask];
+    head.store(h + 1, memory_order_release);
+    return true;
+}
+
+template<typename T>
+size_t SPSCRing<T>::Size() const
+{
+    return tail.load(memory_order_acquire) - head.load(memory_order_acquire);
+}
+
+template<typename T>
+size_t SPSCRing<T>::Capacity() const
+{
+    return mask + 1;
+}
+
+
+template<typename V>
+AsyncServiceListener<V>::AsyncServiceListener(ServiceListener<V>* _listener, size_t _capacity, OverflowPolicy _policy) :
+    listener(_listener), policy(_policy), ring(_capacity), has_pending(false), max_depth(0),
+    dropped(0), conflated(0), processed(0), running(true)
+{
+    consumer = thread(&AsyncServiceListener<V>::Consume, this);
+}
+
+template<typename V>
+AsyncServiceListener<V>::~AsyncServiceListener()
+{
+    Stop();
+}
+
+template<typename V>
+void AsyncServiceListener<V>::ProcessAdd(V& data)
+{
+    Enqueue(ADD_EVENT, data);
+}
+
+template<typename V>
+void AsyncServiceListener<V>::ProcessRemove(V& data)
+{
+    Enqueue(REMOVE_EVENT, data);
+}
+
+template<typename V>
+void AsyncServiceListener<V>::ProcessUpdate(V& data)
+{
+    Enqueue(UPDATE_EVENT, data);
+}
+
+template<typename V>
+void AsyncServiceListener<V>::Stop()
+{
+    if (!consumer.joinable())
+        return;
+    running.store(false, memory_order_release);
+    consumer.join();
+}
+
+template<typename V>
+size_t AsyncServiceListener<V>::GetQueueDepth() const
+{
+    return ring.Size();
+}
+
+template<typename V>
+size_t AsyncServiceListener<V>::GetMaxQueueDepth() const
+{
+    return max_depth.load(memory_order_relaxed);
+}
+
+template<typename V>
+long AsyncServiceListener<V>::GetDropped() const
+{
+    return dropped.load(memory_order_relaxed);
+}
+
+template<typename V>
+long AsyncServiceListener<V>::GetConflated() const
+{
+    return conflated.load(memory_order_relaxed);
+}
+
+template<typename V>
+long AsyncServiceListener<V>::GetProcessed() const
+{
+    return processed.load(memory_order_relaxed);
+}
+
+template<typename V>
+void AsyncServiceListener<V>::Enqueue(EventType type, V& data)
+{
+    Event e{ type, data };
+    // overflowed events go first so the consumer still sees each product's events in order
+    if (has_pending.load(memory_order_acquire))
+    {
+        lock_guard<mutex> lock(pending_mutex);
+        FlushPending();
+        if (has_pending.load(memory_order_relaxed))
+        {
+            PutPending(e);
+            return;
+        }
+    }
+
+    if (ring.TryPush(e))
+    {
+        size_t depth = ring.Size();
+        if (depth > max_depth.load(memory_order_relaxed))
+            max_depth.store(depth, memory_order_relaxed);
+        return;
+    }
+
+    max_depth.store(ring.Capacity(), memory_order_relaxed);
+    if (policy == BLOCK)
+    {
+        PushBlocking(e);
+    }
+    else if (policy == DROP)
+    {
+        dropped.fetch_add(1, memory_order_relaxed);
+    }
+    else
+    {
+        lock_guard<mutex> lock(pending_mutex);
+        PutPending(e);
+    }
+}
+
+template<typename V>
+void AsyncServiceListener<V>::PushBlocking(const Event& e)
+{
+    while (!ring.TryPush(e))
+        this_thread::yield();
+}
+
+template<typename V>
+void AsyncServiceListener<V>::FlushPending()
+{
+    while (!pending_products.empty())
+    {
+        Slot& slot = slots[pending_products.front()];
+        if (!ring.TryPush(slot.event))
+            return;
+        slot.pending = false;
+        pending_products.pop_front();
+    }
+    has_pending.store(false, memory_order_release);
+}
+
+template<typename V>
+void AsyncServiceListener<V>::PutPending(Event& e)
+{
+    int index = e.data.GetProduct().GetProductIndex();
+    if (index >= (int)slots.size())
+        slots.resize(index + 1);
+    Slot& slot = slots[index];
+    slot.event = move(e);
+    if (slot.pending)
+    {
+        conflated.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+    slot.pending = true;
+    pending_products.push_back(index);
+    has_pending.store(true, memory_order_release);
+}
+
+template<typename V>
+bool AsyncServiceListener<V>::TakePending(vector<Event>& events)
+{
+    if (!has_pending.load(memory_order_acquire))
+        return false;
+    lock_guard<mutex> lock(pending_mutex);
+    // the producer moves events to the ring under the lock, those go first
+    if (ring.Size() != 0 || pending_products.empty())
+        return false;
+    for (int index : pending_products)
+    {
+        Slot& slot = slots[index];
+        events.push_back(move(slot.event));
+        slot.pending = false;
+    }
+    pending_products.clear();
+    has_pending.store(false, memory_order_release);
+    return true;
+}
+
+template<typename V>
+void AsyncServiceListener<V>::Dispatch(Event& e, vector<V>& batch)
+{
+    const size_t max_batch = 1024;
+    if (e.type == ADD_EVENT)
+    {
+        batch.push_back(move(e.data));
+        if (batch.size() >= max_batch)
+            DispatchBatch(batch);
+        return;
+    }
+    DispatchBatch(batch);
+    if (e.type == REMOVE_EVENT)
+        listener->ProcessRemove(e.data);
+    else
+        listener->ProcessUpdate(e.data);
+    processed.fetch_add(1, memory_order_relaxed);
+}
+
+template<typename V>
+void AsyncServiceListener<V>::DispatchBatch(vector<V>& batch)
+{
+    if (batch.empty())
+        return;
+    listener->ProcessAddBatch(batch);
+    processed.fetch_add(batch.size(), memory_order_relaxed);
+    batch.clear();
+}
+
+template<typename V>
+void AsyncServiceListener<V>::Consume()
+{
+    Event e;
+    vector<V> batch;
+    vector<Event> overflowed;
+    batch.reserve(1024);
+    int idle = 0;
+    while (true)
+    {
+        if (ring.TryPop(e))
+        {
+            idle = 0;
+            Dispatch(e, batch);
+        }
+        else if (TakePending(overflowed))
+        {
+            idle = 0;
+            for (auto& o : overflowed)
+                Dispatch(o, batch);
+            overflowed.clear();
+        }
+        else if (!batch.empty())
+        {
+            DispatchBatch(batch);
+        }
+        else if (!running.load(memory_order_acquire))
+        {
+            if (ring.Size() == 0 && !has_pending.load(memory_order_acquire))
+                break;
+        }
+        else if (++idle < 64)
+        {
+            this_thread::yield();
+        }
+        else
+        {
+            this_thread::sleep_for(chrono::microseconds(50));
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,310 @@
+
+#ifndef BINARY_FEED_HPP
+#define BINARY_FEED_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "MappedFile.hpp"
+#include "CsvScanner.hpp"
+#include "TickPrice.hpp"
+
+using namespace std;
+
+/*
+* Binary columnar feed format, a pre-parsed form of prices.txt and marketdata.txt.
+*
+*   BinaryFeedHeader
+*   BinaryFeedProduct[product_count]    product id, first record and record count of each product
+*   uint16 product[record_count]        column of file-local product numbers
+*   int32 ticks[record_count]           one column per price field, in 1/256 ticks
+*   ...
+*
+* Every column starts on an 8-byte boundary. Records are grouped by product in the order the
+* products first appear in the text file, so the order within a product is kept, which is all
+* the services downstream depend on. Integers are stored little-endian. The venue column of a
+* multi-venue marketdata.txt is not kept, binary books are read as quoted on one venue.
+*/
+
+// Kind of feed stored in a binary file
+enum BinaryFeedSchema { PRICE_FEED = 1, MARKET_DATA_FEED = 2 };
+
+const char BINARY_FEED_MAGIC[8] = { 'S', 'O', 'A', 'F', 'E', 'E', 'D', '\0' };
+const uint32_t BINARY_FEED_VERSION = 1;
+
+struct BinaryFeedHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t schema;                // BinaryFeedSchema
+    uint32_t price_columns;         // tick columns per record
+    uint32_t product_count;
+    uint64_t record_count;
+};
+
+struct BinaryFeedProduct
+{
+    char product_id[24];            // NUL-padded
+    uint64_t first_record;
+    uint64_t record_count;
+};
+
+// Get the number of price columns of a schema: bid and offer, or five bid/offer pairs
+uint32_t BinaryFeedPriceColumns(BinaryFeedSchema schema);
+
+// Convert a text feed to the binary format, returns false and reports why on failure
+bool ConvertTextFeed(const string& text_file, const string& binary_file, BinaryFeedSchema schema);
+
+
+/**
+ * Reads a binary feed in place from a memory mapping.
+ */
+class BinaryFeedReader
+{
+public:
+    // ctor, maps the file; check IsOpen() for a valid file of the schema
+    BinaryFeedReader(const string& file_name, BinaryFeedSchema _schema);
+
+    // Whether the file is a valid binary feed of the expected schema, with every column in the
+    // file and every record's product number below GetProductCount()
+    bool IsOpen() const;
+
+    // Get the number of records
+    uint64_t GetRecordCount() const;
+
+    // Get the number of price columns per record
+    uint32_t GetPriceColumns() const;
+
+    // Get the number of products
+    uint32_t GetProductCount() const;
+
+    // Get the product id of a file-local product number
+    string_view GetProductId(uint32_t product) const;
+
+    // Get the file-local product number of a record
+    uint16_t GetProduct(uint64_t record) const;
+
+    // Get a price of a record in ticks
+    int32_t GetTicks(uint64_t record, uint32_t column) const;
+
+private:
+    MappedFile file;
+    BinaryFeedHeader header;
+    const BinaryFeedProduct* products;
+    const char* product_column;
+    vector<const char*> tick_columns;
+    bool is_open;
+};
+
+
+// Round a file offset up to the next column boundary
+inline uint64_t AlignColumn(uint64_t offset)
+{
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+uint32_t BinaryFeedPriceColumns(BinaryFeedSchema schema)
+{
+    return schema == PRICE_FEED ? 2 : 10;
+}
+
+bool ConvertTextFeed(const string& text_file, const string& binary_file, BinaryFeedSchema schema)
+{
+    MappedFile in(text_file);
+    if (!in.IsOpen())
+    {
+        cout << "ERROR: File " << text_file << " can not be opened.\n";
+        return false;
+    }
+    const uint32_t columns = BinaryFeedPriceColumns(schema);
+    const size_t max_fields = columns + 1;
+    string_view line, fields[11];
+    size_t field_count;
+
+    // first pass: products and record counts, so each record can be placed in its product's group
+    vector<string> product_ids;
+    vector<uint64_t> counts;
+    vector<uint16_t> record_products;
+    CsvScanner counter(in.GetData());
+    while (counter.NextLine(line, fields, max_fields, field_count))
+    {
+        if (field_count < max_fields)
+            continue;
+        size_t product = 0;
+        while (product < product_ids.size() && product_ids[product] != fields[0])
+            ++product;
+        if (product == product_ids.size())
+        {
+            if (fields[0].size() >= sizeof(BinaryFeedProduct::product_id) || product_ids.size() == 65535)
+            {
+                cout << "ERROR: Product " << fields[0] << " does not fit the binary format.\n";
+                return false;
+            }
+            product_ids.push_back(string(fields[0]));
+            counts.push_back(0);
+        }
+        ++counts[product];
+        record_products.push_back((uint16_t)product);
+    }
+
+    BinaryFeedHeader header;
+    memcpy(header.magic, BINARY_FEED_MAGIC, sizeof(header.magic));
+    header.version = BINARY_FEED_VERSION;
+    header.schema = schema;
+    header.price_columns = columns;
+    header.product_count = (uint32_t)product_ids.size();
+    header.record_count = record_products.size();
+
+    vector<BinaryFeedProduct> products(product_ids.size());
+    vector<uint64_t> cursor(product_ids.size());
+    uint64_t first = 0;
+    for (size_t i = 0; i < products.size(); ++i)
+    {
+        memset(products[i].product_id, 0, sizeof(products[i].product_id));
+        memcpy(products[i].product_id, product_ids[i].data(), product_ids[i].size());
+        products[i].first_record = first;
+        products[i].record_count = counts[i];
+        cursor[i] = first;
+        first += counts[i];
+    }
+
+    // second pass: parse the prices into their columns
+    uint64_t records = header.record_count;
+    vector<uint16_t> product_column(records);
+    vector<int32_t> tick_columns(records * columns);
+    CsvScanner scanner(in.GetData());
+    uint64_t n = 0;
+    long long ticks[10];
+    while (scanner.NextLine(line, fields, max_fields, field_count))
+    {
+        if (field_count < max_fields)
+            continue;
+        uint16_t product = record_products[n++];
+        uint64_t row = cursor[product]++;
+        try
+        {
+            FractionalToTicks(fields + 1, columns, ticks);
+        }
+        catch (const exception& e)
+        {
+            cout << "ERROR: " << e.what() << " in " << text_file << ".\n";
+            return false;
+        }
+        product_column[row] = product;
+        for (uint32_t c = 0; c < columns; ++c)
+            tick_columns[c * records + row] = (int32_t)ticks[c];
+    }
+
+    ofstream out(binary_file, ios::binary | ios::trunc);
+    if (!out.is_open())
+    {
+        cout << "ERROR: File " << binary_file << " can not be opened.\n";
+        return false;
+    }
+    const char padding[8] = {};
+    uint64_t offset = sizeof(header) + products.size() * sizeof(BinaryFeedProduct);
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)products.data(), products.size() * sizeof(BinaryFeedProduct));
+    out.write(padding, AlignColumn(offset) - offset);
+    offset = AlignColumn(offset) + records * sizeof(uint16_t);
+    out.write((const char*)product_column.data(), records * sizeof(uint16_t));
+    for (uint32_t c = 0; c < columns; ++c)
+    {
+        out.write(padding, AlignColumn(offset) - offset);
+        offset = AlignColumn(offset) + records * sizeof(int32_t);
+        out.write((const char*)(tick_columns.data() + c * records), records * sizeof(int32_t));
+    }
+    out.close();
+    if (!out)
+    {
+        cout << "ERROR: File " << binary_file << " could not be written.\n";
+        return false;
+    }
+    return true;
+}
+
+
+BinaryFeedReader::BinaryFeedReader(const string& file_name, BinaryFeedSchema _schema) :
+    file(file_name), header(), products(nullptr), product_column(nullptr), is_open(false)
+{
+    string_view data = file.GetData();
+    if (!file.IsOpen() || data.size() < sizeof(header))
+        return;
+    memcpy(&header, data.data(), sizeof(header));
+    if (memcmp(header.magic, BINARY_FEED_MAGIC, sizeof(header.magic)) != 0 || header.version != BINARY_FEED_VERSION ||
+        header.schema != (uint32_t)_schema || header.price_columns != BinaryFeedPriceColumns(_schema))
+        return;
+
+    // sizes come from the file, so each is checked against what is left before it is multiplied
+    uint64_t size = data.size();
+    if (header.product_count > (size - sizeof(header)) / sizeof(BinaryFeedProduct))
+        return;
+    uint64_t offset = sizeof(header) + (uint64_t)header.product_count * sizeof(BinaryFeedProduct);
+    products = (const BinaryFeedProduct*)(data.data() + sizeof(header));
+    for (uint32_t c = 0; c <= header.price_columns; ++c)
+    {
+        uint64_t width = c == 0 ? sizeof(uint16_t) : sizeof(int32_t);
+        offset = AlignColumn(offset);
+        if (offset > size || header.record_count > (size - offset) / width)
+            return;
+        if (c == 0)
+            product_column = data.data() + offset;
+        else
+            tick_columns.push_back(data.data() + offset);
+        offset += header.record_count * width;
+    }
+
+    for (uint64_t i = 0; i < header.record_count; ++i)
+    {
+        if (GetProduct(i) >= header.product_count)
+            return;
+    }
+    is_open = true;
+}
+
+bool BinaryFeedReader::IsOpen() const
+{
+    return is_open;
+}
+
+uint64_t BinaryFeedReader::GetRecordCount() const
+{
+    return header.record_count;
+}
+
+uint32_t BinaryFeedReader::GetPriceColumns() const
+{
+    return header.price_columns;
+}
+
+uint32_t BinaryFeedReader::GetProductCount() const
+{
+    return header.product_count;
+}
+
+string_view BinaryFeedReader::GetProductId(uint32_t product) const
+{
+    const char* id = products[product].product_id;
+    return string_view(id, strnlen(id, sizeof(products[product].product_id)));
+}
+
+uint16_t BinaryFeedReader::GetProduct(uint64_t record) const
+{
+    uint16_t product;
+    memcpy(&product, product_column + record * sizeof(uint16_t), sizeof(product));
+    return product;
+}
+
+int32_t BinaryFeedReader::GetTicks(uint64_t record, uint32_t column) const
+{
+    int32_t ticks;
+    memcpy(&ticks, tick_columns[column] + record * sizeof(int32_t), sizeof(ticks));
+    return ticks;
+}
+
+#endif
@@ -0,0 +1,258 @@
+
+#ifndef CONFLATING_SERVICE_LISTENER_HPP
+#define CONFLATING_SERVICE_LISTENER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "SOA.hpp"
+
+using namespace std;
+
+
+/**
+ * Listener adapter that keeps only the latest event of each product for a slow listener.
+ * The notifying service stores each event in its product's slot, overwriting one that has
+ * not been delivered yet, and a consumer thread hands the slots to the wrapped listener.
+ * Products are delivered in the order they became pending, and a product updated again
+ * after delivery queues up behind the others, so a busy product can not starve the rest.
+ * A listener that falls behind sees fewer, fresher events instead of a growing queue.
+ * Works for any event with GetProduct(), such as OrderBook<T> and Price<T>; the remove and
+ * update events of a product are conflated with its add events, the latest one wins.
+ * Type V is the event type.
+ */
+template<typename V>
+class ConflatingServiceListener : public ServiceListener<V>
+{
+public:
+    // ctor, starts the consumer thread
+    ConflatingServiceListener(ServiceListener<V>* _listener);
+    ~ConflatingServiceListener();
+
+    // Listener callback to process an add event to the Service
+    void ProcessAdd(V& data);
+
+    // Listener callback to process a remove event to the Service
+    void ProcessRemove(V& data);
+
+    // Listener callback to process an update event to the Service
+    void ProcessUpdate(V& data);
+
+    // Listener callback to process a batch of add events to the Service
+    void ProcessAddBatch(vector<V>& data);
+
+    // Deliver what is pending and stop the consumer thread
+    void Stop();
+
+    // Get the number of products with an event waiting for delivery
+    size_t GetPendingProducts();
+
+    // Get the number of events overwritten before they were delivered
+    long GetConflated() const;
+
+    // Get the number of events handed to the wrapped listener
+    long GetProcessed() const;
+
+private:
+    enum EventType { ADD_EVENT, REMOVE_EVENT, UPDATE_EVENT };
+
+    struct Slot
+    {
+        V data;
+        EventType type = ADD_EVENT;
+        bool pending = false;
+    };
+
+    ServiceListener<V>* listener;
+    mutex slots_mutex;              // guards everything down to waiting
+    condition_variable ready_cv;
+    vector<Slot> slots;             // by product index
+    deque<int> ready;               // pending products, in the order they became pending
+    bool running;
+    bool waiting;                   // the consumer sleeps on ready_cv
+    atomic<long> conflated;
+    atomic<long> processed;
+    thread consumer;
+
+    // Store an event in its product's slot, slots_mutex must be held
+    void Put(EventType type, V& data);
+
+    // Store an event and wake the consumer
+    void Enqueue(EventType type, V& data);
+
+    // Hand a run of add events to the wrapped listener
+    void DispatchBatch(vector<V>& batch);
+
+    // Consumer thread loop
+    void Consume();
+};
+
+
+template<typename V>
+ConflatingServiceListener<V>::ConflatingServiceListener(ServiceListener<V>* _listener) :
+    listener(_listener), running(true), waiting(false), conflated(0), processed(0)
+{
+    consumer = thread(&ConflatingServiceListener<V>::Consume, this);
+}
+
+template<typename V>
+ConflatingServiceListener<V>::~ConflatingServiceListener()
+{
+    Stop();
+}
+
+template<typename V>
+void ConflatingServiceListener<V>::ProcessAdd(V& data)
+{
+    Enqueue(ADD_EVENT, data);
+}
+
+template<typename V>
+void ConflatingServiceListener<V>::ProcessRemove(V& data)
+{
+    Enqueue(REMOVE_EVENT, data);
+}
+
+template<typename V>
+void ConflatingServiceListener<V>::ProcessUpdate(V& data)
+{
+    Enqueue(UPDATE_EVENT, data);
+}
+
+template<typename V>
+void ConflatingServiceListener<V>::ProcessAddBatch(vector<V>& data)
+{
+    bool wake;
+    {
+        lock_guard<mutex> lock(slots_mutex);
+        for (auto& e : data)
+            Put(ADD_EVENT, e);
+        wake = waiting && !ready.empty();
+    }
+    if (wake)
+        ready_cv.notify_one();
+}
+
+template<typename V>
+void ConflatingServiceListener<V>::Stop()
+{
+    if (!consumer.joinable())
+        return;
+    {
+        lock_guard<mutex> lock(slots_mutex);
+        running = false;
+    }
+    ready_cv.notify_one();
+    consumer.join();
+}
+
+template<typename V>
+size_t ConflatingServiceListener<V>::GetPendingProducts()
+{
+    lock_guard<mutex> lock(slots_mutex);
+    return ready.size();
+}
+
+template<typename V>
+long ConflatingServiceListener<V>::GetConflated() const
+{
+    return conflated.load(memory_order_relaxed);
+}
+
+template<typename V>
+long ConflatingServiceListener<V>::GetProcessed() const
+{
+    return processed.load(memory_order_relaxed);
+}
+
+template<typename V>
+void ConflatingServiceListener<V>::Put(EventType type, V& data)
+{
+    int index = data.GetProduct().GetProductIndex();
+    if (index >= (int)slots.size())
+        slots.resize(index + 1);
+    Slot& slot = slots[index];
+    slot.data = data;
+    slot.type = type;
+    if (slot.pending)
+    {
+        conflated.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+    slot.pending = true;
+    ready.push_back(index);
+}
+
+template<typename V>
+void ConflatingServiceListener<V>::Enqueue(EventType type, V& data)
+{
+    bool wake;
+    {
+        lock_guard<mutex> lock(slots_mutex);
+        Put(type, data);
+        wake = waiting;
+    }
+    if (wake)
+        ready_cv.notify_one();
+}
+
+template<typename V>
+void ConflatingServiceListener<V>::DispatchBatch(vector<V>& batch)
+{
+    if (batch.empty())
+        return;
+    listener->ProcessAddBatch(batch);
+    processed.fetch_add(batch.size(), memory_order_relaxed);
+    batch.clear();
+}
+
+template<typename V>
+void ConflatingServiceListener<V>::Consume()
+{
+    vector<V> events;
+    vector<EventType> types;
+    vector<V> batch;
+    while (true)
+    {
+        // take every pending product at once, each slot is free for the next event right away
+        {
+            unique_lock<mutex> lock(slots_mutex);
+            waiting = true;
+            ready_cv.wait(lock, [this]() { return !ready.empty() || !running; });
+            waiting = false;
+            if (ready.empty())
+                break;
+            for (int index : ready)
+            {
+                Slot& slot = slots[index];
+                events.push_back(slot.data);
+                types.push_back(slot.type);
+                slot.pending = false;
+            }
+            ready.clear();
+        }
+
+        for (size_t i = 0; i < events.size(); ++i)
+        {
+            if (types[i] == ADD_EVENT)
+            {
+                batch.push_back(events[i]);
+                continue;
+            }
+            DispatchBatch(batch);
+            if (types[i] == REMOVE_EVENT)
+                listener->ProcessRemove(events[i]);
+            else
+                listener->ProcessUpdate(events[i]);
+            processed.fetch_add(1, memory_order_relaxed);
+        }
+        DispatchBatch(batch);
+        events.clear();
+        types.clear();
+    }
+}
+
+#endif
@@ -7,10 +7,20 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <charconv>
 #include <boost/date_time.hpp>
 
 #include "SOA.hpp"
+#include "TickPrice.hpp"
 #include "DataGenerator.hpp"
+#include "MappedFile.hpp"
+#include "CsvScanner.hpp"
+#include "BinaryFeed.hpp"
+#include "OrderedChunkParser.hpp"
+#include "OutputFile.hpp"
+#include "TickStore.hpp"
+#include "SyntheticFeed.hpp"
 #include "HistoricalDataService.hpp"
 #include "StreamingService.hpp"
 #include "PricingService.hpp"
@@ -19,50 +29,55 @@
 #include "MarketDataService.hpp"
 #include "ExecutionService.hpp"
 #include "InquiryService.hpp"
-#include "TradeBookingservice.hpp"
+#include "TradeBookingService.hpp"
 
 using namespace std;
 using namespace boost::posix_time;
 
-// Convert the fractional bond price to a numerical price
-double FractionalToPrice(string frac_price)
+// Convert a decimal integer field to a number
+long FieldToLong(string_view field)
 {
-    double price;
-    string s1 = "";
-    string s2 = "";
-    string s3 = "";
+    long value = 0;
+    from_chars(field.data(), field.data() + field.size(), value);
+    return value;
+}
 
-    int cnt = 0;
-    for (int i = 0; i < frac_price.size(); i++)
+// Look up each product of a binary feed in the catalog, unknown products are reported and map to nullptr
+template<typename V>
+vector<const V*> FindFeedProducts(const BinaryFeedReader& feed)
+{
+    vector<const V*> products(feed.GetProductCount());
+    for (uint32_t i = 0; i < feed.GetProductCount(); ++i)
     {
-        if (frac_price[i] == '-')
-        {
-            ++cnt;
-            continue;
-        }
+        products[i] = g_bonds.Find(feed.GetProductId(i));
+        if (products[i] == nullptr)
+            cout << to_simple_string(microsec_clock::local_time()) << "  ERROR: Unknown product " << feed.GetProductId(i) << " skipped.\n";
+    }
+    return products;
+}
 
-        if (cnt == 0)
-            s1.push_back(frac_price[i]);
-        else if (cnt == 1)
-        {
-            s2.push_back(frac_price[i]);
-            cnt++;
-        }
-        else if (cnt == 2)
-        {
-            s2.push_back(frac_price[i]);
-            cnt++;
-        }
-        else
-        {
-            if (frac_price[i] == '+')
-                frac_price[i] = '4';
-            s3.push_back(frac_price[i]);
-        }
+// Look up the products of a synthetic feed in the catalog, unknown products are reported and map to nullptr
+template<typename V>
+vector<const V*> FindSyntheticProducts(const SyntheticFeedOptions& options)
+{
+    vector<const V*> products(min(options.product_count, g_product_Ids.size()));
+    for (size_t i = 0; i < products.size(); ++i)
+    {
+        products[i] = g_bonds.Find(g_product_Ids[i]);
+        if (products[i] == nullptr)
+            cout << to_simple_string(microsec_clock::local_time()) << "  ERROR: Unknown product " << g_product_Ids[i] << " skipped.\n";
     }
+    return products;
+}
 
-    price = stod(s1) + stod(s2) * 1.0 / 32.0 + stod(s3) * 1.0 / 256.0;
-    return price;
+// Make the id of a synthetic trade or inquiry the way DataGenerator.hpp numbers them
+inline string SyntheticId(const char* prefix, uint64_t number)
+{
+    string id(prefix);
+    if (number < 10)
+        id += '0';
+    id += to_string(number);
+    return id;
 }
 
 
@@ -71,19 +86,34 @@ template <typename V>
 class HistoricalPositionConnector :public Connector<Position<V>>
 {
 public:
-    void Publish(Position<V> data)      // print the position into the file
+    HistoricalPositionConnector() : file(OutputRegistry::Instance().Get("output/positions.txt")) {}
+
+    void Publish(Position<V>& data)      // print the position into the file
+    {
+        OutputWriter out(file);
+        Write(out.Stream(), data);
+    }
+
+    void PublishBatch(vector<Position<V> >& data)       // print a block of positions into the file
+    {
+        OutputWriter out(file);
+        for (auto& e : data)
+            Write(out.Stream(), e);
+    }
+
+    void Subscribe(string file_name) {}     // publish only
+
+private:
+    OutputFile& file;
+
+    void Write(ostream& out, Position<V>& data)
     {
-        ofstream out("output/positions.txt", ios::app);
-        V product = data.GetProduct();
-        out << product.GetProductId() << ", ";
+        out << data.GetProduct().GetProductId() << ", ";
         map<string, double> positions = data.GetAllPositions();
         for (auto& ele : positions)
             out << ele.first << ":" << ele.second << " ";
-        out << endl;
-        out.close();
+        out << '\n';
     }
-
-    void Subscribe(string file_name) {}     // publish only
 };
 
 
@@ -92,16 +122,31 @@ template <typename V>
 class HistoricalRiskConnector :public Connector<PV01<V>>
 {
 public:
-    void Publish(PV01<V> data)       // print the risk into the file
+    HistoricalRiskConnector() : file(OutputRegistry::Instance().Get("output/risk.txt")) {}
+
+    void Publish(PV01<V>& data)       // print the risk into the file
+    {
+        OutputWriter out(file);
+        Write(out.Stream(), data);
+    }
+
+    void PublishBatch(vector<PV01<V> >& data)       // print a block of risks into the file
     {
-        ofstream out("output/risk.txt", ios::app);
-        V product = data.GetProduct();
-        out << product.GetProductId() << ", " << data.GetPV01() << ", "
-            << data.GetQuantity() << endl;
-        out.close();
+        OutputWriter out(file);
+        for (auto& e : data)
+            Write(out.Stream(), e);
     }
 
     void Subscribe(string file_name) {}     // publish only
+
+private:
+    OutputFile& file;
+
+    void Write(ostream& out, PV01<V>& data)
+    {
+        out << data.GetProduct().GetProductId() << ", " << data.GetPV01() << ", "
+            << data.GetQuantity() << '\n';
+    }
 };
 
 
@@ -110,18 +155,31 @@ template<typename V>
 class HistoricalStreamingConnector : public Connector<PriceStream<V> >
 {
 public:
-    void Publish(PriceStream<V> data)      // print the price streams into the file
+    HistoricalStreamingConnector() : file(OutputRegistry::Instance().Get("output/streaming.txt")) {}
+
+    void Publish(PriceStream<V>& data)      // print the price streams into the file
+    {
+        OutputWriter out(file);
+        Write(out.Stream(), data);
+    }
+
+    void PublishBatch(vector<PriceStream<V> >& data)       // print a block of price streams into the file
     {
-        ofstream out("output/streaming.txt", ios::app);
-        V product = data.GetProduct();
-        PriceStreamOrder bid_order = data.GetBidOrder();
-        PriceStreamOrder offer_order = data.GetOfferOrder();
-        out << product.GetProductId() << ", " << bid_order.GetPrice() << ", " << 
-            offer_order.GetPrice() << endl;
-        out.close();
+        OutputWriter out(file);
+        for (auto& e : data)
+            Write(out.Stream(), e);
     }
 
     void Subscribe(string file_name) {}     // publish only
+
+private:
+    OutputFile& file;
+
+    void Write(ostream& out, PriceStream<V>& data)
+    {
+        out << data.GetProduct().GetProductId() << ", " << data.GetBidOrder().GetPrice() << ", " <<
+            data.GetOfferOrder().GetPrice() << '\n';
+    }
 };
 
 
@@ -130,23 +188,38 @@ template<typename V>
 class HistoricalExecutionConnector : public Connector<ExecutionOrder<V> >
 {
 public:
-    void Publish(ExecutionOrder<V> data)        // print the execution records into the file
+    HistoricalExecutionConnector() : file(OutputRegistry::Instance().Get("output/executions.txt")) {}
+
+    void Publish(ExecutionOrder<V>& data)        // print the execution records into the file
+    {
+        OutputWriter out(file);
+        Write(out.Stream(), data);
+    }
+
+    void PublishBatch(vector<ExecutionOrder<V> >& data)        // print a block of execution records into the file
+    {
+        OutputWriter out(file);
+        for (auto& e : data)
+            Write(out.Stream(), e);
+    }
+
+    void Subscribe(string file_name) {}     // publish only
+
+private:
+    OutputFile& file;
+
+    void Write(ostream& out, ExecutionOrder<V>& data)
     {
-        ofstream out("output/executions.txt", ios::app);
-        V product = data.GetProduct();
         string side;
         if (data.GetPricingSide() == BID)
             side = "BUY";
         else
             side = "SELL";
 
-        out << product.GetProductId() << "," << data.GetOrderId() << ","
+        out << data.GetProduct().GetProductId() << "," << data.GetOrderId() << ","
             << side << "," << data.GetPrice() << "," << 
-            data.GetVisibleQuantity() << "," << data.GetHiddenQuantity() << endl;
-        out.close();
+            data.GetVisibleQuantity() << "," << data.GetHiddenQuantity() << '\n';
     }
-
-    void Subscribe(string file_name) {}     // publish only
 };
 
 
@@ -155,9 +228,10 @@ template<typename V>
 class HistoricalInquiryConnector : public Connector<Inquiry<V> >
 {
 public:
-    void Publish(Inquiry<V> data)       // print the inquiry data into the file
+    HistoricalInquiryConnector() : file(OutputRegistry::Instance().Get("output/all_inquiries.txt")) {}
+
+    void Publish(Inquiry<V>& data)       // print the inquiry data into the file
     {
-        ofstream out("output/all_inquiries.txt", ios::app);
         string state;
         InquiryState state_enum = data.GetState();
         if (state_enum == RECEIVED)
@@ -173,12 +247,74 @@ public:
         else
             side = "SELL";
         
-        out << data.GetProduct().GetProductId() << ", " << data.GetInquiryId()
+        OutputWriter out(file);
+        out.Stream() << data.GetProduct().GetProductId() << ", " << data.GetInquiryId()
             << ", " << side << ", " << data.GetPrice() << ", " << state << endl;
-        out.close();
     }
 
     void Subscribe(string file_name) {}     // publish only
+
+private:
+    OutputFile& file;
+};
+
+
+// Connector to the historical market data service, keeps every order book in a tick store
+template<typename V>
+class HistoricalMarketDataConnector : public Connector<OrderBook<V> >
+{
+public:
+    HistoricalMarketDataConnector() : store("output/marketdata.tick") {}
+
+    void Publish(OrderBook<V>& data)        // append the order book to the store
+    {
+        ToSnapshot(data, snapshot);
+        store.Append(snapshot);
+    }
+
+    void PublishBatch(vector<OrderBook<V> >& data)      // append a block of order books to the store
+    {
+        for (auto& e : data)
+        {
+            ToSnapshot(e, snapshot);
+            store.Append(snapshot);
+        }
+    }
+
+    void Subscribe(string file_name) {}     // publish only
+
+    void Close()        // write the index of the store, read it back with tick_reader
+    {
+        store.Close();
+    }
+
+private:
+    TickStoreWriter store;
+    vector<int> store_products;     // store product number by product index, -1 until first seen
+    TickSnapshot snapshot;
+
+    void ToSnapshot(OrderBook<V>& data, TickSnapshot& out)
+    {
+        const V& product = data.GetProduct();
+        size_t index = product.GetProductIndex();
+        if (index >= store_products.size())
+            store_products.resize(index + 1, -1);
+        if (store_products[index] < 0)
+            store_products[index] = (int)store.AddProduct(product.GetProductId());
+        out.product = store_products[index];
+
+        out.bid_levels = (uint32_t)min(data.GetBidDepth(), (size_t)TICK_STORE_DEPTH);
+        out.offer_levels = (uint32_t)min(data.GetOfferDepth(), (size_t)TICK_STORE_DEPTH);
+        for (uint32_t i = 0; i < TICK_STORE_DEPTH; ++i)
+        {
+            bool bid = i < out.bid_levels;
+            bool offer = i < out.offer_levels;
+            out.bid_ticks[i] = bid ? data.GetBidPrice(i).GetTicks() : 0;
+            out.bid_quantities[i] = bid ? data.GetBidQuantity(i) : 0;
+            out.offer_ticks[i] = offer ? data.GetOfferPrice(i).GetTicks() : 0;
+            out.offer_quantities[i] = offer ? data.GetOfferQuantity(i) : 0;
+        }
+    }
 };
 
 
@@ -187,207 +323,548 @@ template<typename V>
 class GUIConnector : public Connector<Price<V> >
 {
 public:
-    GUIConnector() = default;
+    GUIConnector() : file(OutputRegistry::Instance().Get("output/gui.txt")) {}
 
     void Publish(Price<V>& data)
     {
-        ofstream out("output/gui.txt", ios::app);
         ptime cur_time = microsec_clock::local_time();
-        V product = data.GetProduct();
-        out << cur_time << "  " << product.GetProductId() << ", " << data.GetMid() << ", "
+        const V& product = data.GetProduct();
+        OutputWriter out(file);
+        out.Stream() << cur_time << "  " << product.GetProductId() << ", " << data.GetMid() << ", "
             << data.GetBidOfferSpread() << endl;
-        out.close();
     }
 
     void Subscribe(string file_name) {}     // publish only
+
+private:
+    OutputFile& file;
 };
 
 
 // Connector to the trade booking service
-template<typename V>
+template<typename V, typename S = TradeBookingService<V> >
 class TradeBookingConnector : public Connector<Trade<V>>
 {
 private:
-    TradeBookingService<V>* service;
+    S* service;
+    size_t batch_size;      // number of parsed lines handed to the service per call
 
 public:
-    TradeBookingConnector(TradeBookingService<V>* _service) : service(_service) {}
+    TradeBookingConnector(S* _service, size_t _batch_size = 512) : service(_service), batch_size(_batch_size) {}
 
     void Publish(Trade<V>& data) {}   // subsribe-only
 
+    bool ParseLine(string_view line, Trade<V>& trade)       // parse one trading record, false if it is skipped
+    {
+        string_view line_seg[6];
+        return ParseFields(line_seg, SplitFields(line, line_seg, 6), trade);
+    }
+
+    bool ParseFields(const string_view* line_seg, size_t field_count, Trade<V>& trade)      // build a trade from the fields of a record
+    {
+        if (field_count < 6)      // blank or truncated line
+            return false;
+
+        string_view productID = line_seg[0];
+        const V* product = g_bonds.Find(productID);
+        if (product == nullptr)
+        {
+            cout << to_simple_string(microsec_clock::local_time()) << "  ERROR: Unknown product " << productID << " skipped.\n";
+            return false;
+        }
+        string tradeID(line_seg[1]);
+        string book(line_seg[2]);
+        TickPrice price(FractionalToTicks(line_seg[3]));        // get the price in ticks
+
+        long quantity = FieldToLong(line_seg[4]);
+        Side side;
+        if (line_seg[5] == "BUY")
+            side = BUY;
+        else
+            side = SELL;
+
+        trade = Trade<V>(*product, tradeID, price, book, quantity, side);
+        return true;
+    }
+
     void Subscribe(string file_name)        // Read trading records from the given file
     {
-        ifstream in(file_name);
+        MappedFile in(file_name);
         ptime cur_time;
-        if (in.is_open()) 
+        if (in.IsOpen()) 
         {
             cur_time = microsec_clock::local_time();
-            cout << cur_time << "  Processing trade data from " << file_name << "..." << endl;
-            string line;
-            vector<string> line_seg;
-            while (getline(in, line))
+            cout << to_simple_string(cur_time) << "  Processing trade data from " << file_name << "..." << endl;
+            CsvScanner scanner(in.GetData());
+            string_view line, line_seg[6];
+            size_t field_count;
+            Trade<V> trade;
+            vector<Trade<V> > batch;
+            batch.reserve(batch_size);
+            while (scanner.NextLine(line, line_seg, 6, field_count))
             {
-                string seg;
-                line_seg.clear();
-                stringstream line_stream(line);
-                while (getline(line_stream, seg, ','))      // parse the comma-separated string
+                if (!ParseFields(line_seg, field_count, trade))
+                    continue;
+                batch.push_back(trade);
+                if (batch.size() == batch_size)
                 {
-                    line_seg.push_back(seg);
+                    service->OnMessageBatch(batch);
+                    batch.clear();
                 }
-
-                string productID = line_seg[0];
-                V product = Bond(productID, CUSIP, g_tickers[productID], g_coupons[productID], g_dates[productID]);
-                string tradeID = line_seg[1];
-                string book = line_seg[2];
-                double price = FractionalToPrice(line_seg[3]);      // get the decimal price
-                
-                long quantity = stol(line_seg[4]);
-                Side side;
-                if (line_seg[5] == "BUY")
-                    side = BUY;
-                else
-                    side = SELL;
-                
-                Trade<V> trade(product, tradeID, price, book, quantity, side);
-                service->OnMessage(trade);
             }
+            if (!batch.empty())
+                service->OnMessageBatch(batch);
             cur_time = microsec_clock::local_time();
-            cout << cur_time << "  Trade data processed.\n\n";
+            cout << to_simple_string(cur_time) << "  Trade data processed.\n\n";
         }
         else
         {
             cur_time = microsec_clock::local_time();
-            cout << cur_time << "  ERROR: File " << file_name << " can not be opened.\n\n";
+            cout << to_simple_string(cur_time) << "  ERROR: File " << file_name << " can not be opened.\n\n";
         }
     }
+
+    void SubscribeSynthetic(const SyntheticFeedOptions& options)      // generate trades in memory, as Generate_Trades would write them
+    {
+        ptime cur_time = microsec_clock::local_time();
+        cout << to_simple_string(cur_time) << "  Processing synthetic trade data..." << endl;
+        vector<const V*> products = FindSyntheticProducts<V>(options);
+        uint64_t count = RunSyntheticFeed<Trade<V> >(options, "trades", batch_size,
+            [&products](SplitMix64& rng, size_t product, uint64_t index, uint64_t event, Trade<V>& trade)
+        {
+            TickPrice price(RandomPriceTicks(rng));
+            if (products[product] == nullptr)
+                return false;
+            trade = Trade<V>(*products[product], SyntheticId("TRADEID_", event + 1), price, books[event % 3],
+                (long)(1000000 * (index % 5 + 1)), index % 2 == 0 ? BUY : SELL);
+            return true;
+        }, [this](vector<Trade<V> >& batch) { service->OnMessageBatch(batch); });
+        cur_time = microsec_clock::local_time();
+        cout << to_simple_string(cur_time) << "  " << count << " synthetic trades processed.\n\n";
+    }
 };
 
 
 // Connector to the pricing service
-template<typename V>
+template<typename V, typename S = PricingService<V> >
 class PricingConnector : public Connector<Price <V> >
 {
 private:
-    PricingService<V>* service;
+    S* service;
+    size_t batch_size;      // number of parsed lines handed to the service per call
 
 public:
-    PricingConnector(PricingService<V>* _service) : service(_service) {}
+    PricingConnector(S* _service, size_t _batch_size = 512) : service(_service), batch_size(_batch_size) {}
 
     void Publish(Price <V>& data) {}        // subscribe only
 
+    bool ParseLine(string_view line, Price<V>& price)       // parse one price record, false if it is skipped
+    {
+        string_view line_seg[3];
+        return ParseFields(line_seg, SplitFields(line, line_seg, 3), price);
+    }
+
+    bool ParseFields(const string_view* line_seg, size_t field_count, Price<V>& price)      // build a price from the fields of a record
+    {
+        if (field_count < 3)      // blank or truncated line
+            return false;
+
+        string_view productID = line_seg[0];
+        const V* product = g_bonds.Find(productID);
+        if (product == nullptr)
+        {
+            cout << to_simple_string(microsec_clock::local_time()) << "  ERROR: Unknown product " << productID << " skipped.\n";
+            return false;
+        }
+        TickPrice bid(FractionalToTicks(line_seg[1]));
+        TickPrice ask(FractionalToTicks(line_seg[2]));
+
+        price = Price<V>(*product, bid, ask);
+        return true;
+    }
+
     void Subscribe(string file_name)        // read price data from the given file
     {
-        ifstream in(file_name);
+        MappedFile in(file_name);
         int counter = 0;
         ptime cur_time;
-        if (in.is_open())
+        if (in.IsOpen())
         {
             cur_time = microsec_clock::local_time();
-            cout << cur_time << "  Processing price data from " << file_name << "..." << endl;
-            string line;
-            while (getline(in, line))
+            cout << to_simple_string(cur_time) << "  Processing price data from " << file_name << "..." << endl;
+            CsvScanner scanner(in.GetData());
+            string_view line, line_seg[3];
+            size_t field_count;
+            Price<V> price;
+            vector<Price<V> > batch;
+            batch.reserve(batch_size);
+            while (scanner.NextLine(line, line_seg, 3, field_count))
             {
                 ++counter;
                 if (counter > 1000000)
                     counter = 1;
-                string seg;
-                vector<string> line_seg;
-                stringstream line_stream(line);
-                while (getline(line_stream, seg, ','))      // parse the comma-separated string
+                if (!ParseFields(line_seg, field_count, price))
+                    continue;
+                if (counter % 100000 == 0)
                 {
-                    line_seg.push_back(seg);
+                    cur_time = microsec_clock::local_time();
+                    cout << to_simple_string(cur_time) << "  " << counter << " prices processed for " << price.GetProduct().GetProductId() << ".\n";
                 }
 
-                string productID = line_seg[0];
-                if (counter % 100000 == 0)
+                batch.push_back(price);
+                if (batch.size() == batch_size)
                 {
-                    cur_time = microsec_clock::local_time();
-                    cout << cur_time << "  " << counter << " prices processed for " << productID << ".\n";
+                    service->OnMessageBatch(batch);
+                    batch.clear();
+                }
+            }
+            if (!batch.empty())
+                service->OnMessageBatch(batch);
+            cur_time = microsec_clock::local_time();
+            cout << to_simple_string(cur_time) << "  Price data processed.\n\n";
+        }
+        else
+        {
+            cur_time = microsec_clock::local_time();
+            cout << to_simple_string(cur_time) << "  ERROR: File " << file_name << " can not be opened.\n\n";
+        }
+    }
+
+    void SubscribeBinary(string file_name)      // read price data from a binary feed made by feed_converter
+    {
+        BinaryFeedReader in(file_name, PRICE_FEED);
+        ptime cur_time;
+        if (in.IsOpen())
+        {
+            cur_time = microsec_clock::local_time();
+            cout << to_simple_string(cur_time) << "  Processing binary price data from " << file_name << "..." << endl;
+            vector<const V*> products = FindFeedProducts<V>(in);
+            vector<Price<V> > batch;
+            batch.reserve(batch_size);
+            for (uint64_t i = 0; i < in.GetRecordCount(); ++i)
+            {
+                const V* product = products[in.GetProduct(i)];
+                if (product == nullptr)
+                    continue;
+                batch.push_back(Price<V>(*product, TickPrice(in.GetTicks(i, 0)), TickPrice(in.GetTicks(i, 1))));
+                if (batch.size() == batch_size)
+                {
+                    service->OnMessageBatch(batch);
+                    batch.clear();
                 }
-                V product = Bond(productID, CUSIP, g_tickers[productID], g_coupons[productID], g_dates[productID]);
-                double bid = FractionalToPrice(line_seg[1]);
-                double ask = FractionalToPrice(line_seg[2]);
-                double mid = (bid + ask) / 2;
-                double spread = ask - bid;
-
-                Price<V> price(product, mid, spread);
-                service->OnMessage(price);
             }
+            if (!batch.empty())
+                service->OnMessageBatch(batch);
             cur_time = microsec_clock::local_time();
-            cout << cur_time << "  Price data processed.\n\n";
+            cout << to_simple_string(cur_time) << "  Price data processed.\n\n";
         }
         else
         {
             cur_time = microsec_clock::local_time();
-            cout << cur_time << "  ERROR: File " << file_name << " can not be opened.\n\n";
+            cout << to_simple_string(cur_time) << "  ERROR: File " << file_name << " is not a binary price feed.\n\n";
         }
     }
+
+    void SubscribeSynthetic(const SyntheticFeedOptions& options)      // generate prices in memory, as Generate_Prices would write them
+    {
+        ptime cur_time = microsec_clock::local_time();
+        cout << to_simple_string(cur_time) << "  Processing synthetic price data..." << endl;
+        vector<const V*> products = FindSyntheticProducts<V>(options);
+        uint64_t count = RunSyntheticFeed<Price<V> >(options, "prices", batch_size,
+            [&products](SplitMix64& rng, size_t product, uint64_t, uint64_t, Price<V>& price)
+        {
+            int bid, offer;
+            RandomBidOffer(rng, bid, offer);
+            if (products[product] == nullptr)
+                return false;
+            price = Price<V>(*products[product], TickPrice(bid), TickPrice(offer));
+            return true;
+        }, [this](vector<Price<V> >& batch) { service->OnMessageBatch(batch); });
+        cur_time = microsec_clock::local_time();
+        cout << to_simple_string(cur_time) << "  " << count << " synthetic prices processed.\n\n";
+    }
 };
 
 
 // Connector to the market data service
-template<typename V>
+template<typename V, typename S = MarketDataService<V> >
 class MarketDataConnector : public Connector<OrderBook <V> >
 {
 private:
-    MarketDataService<V>* service;
+    S* service;
+    size_t batch_size;      // number of parsed lines handed to the service per call
+    size_t parse_threads;   // threads parsing the file, books still reach the service in file order
+    static const size_t chunk_bytes = 1 << 18;      // bytes of the file parsed per task when parsing in parallel
 
 public:
-    MarketDataConnector(MarketDataService<V>* _service) : service(_service) {}
+    MarketDataConnector(S* _service, size_t _batch_size = 512, size_t _parse_threads = 1) :
+        service(_service), batch_size(_batch_size), parse_threads(_parse_threads) {}
     
     void Publish(OrderBook <V>& data) {}      // subscribe only
 
+    bool ParseLine(string_view line, OrderBook<V>& orderbook)       // parse one order book record, false if it is skipped
+    {
+        string_view line_seg[12];
+        return ParseFields(line_seg, SplitFields(line, line_seg, 12), orderbook);
+    }
+
+    bool ParseFields(const string_view* line_seg, size_t field_count, OrderBook<V>& orderbook)      // build an order book from the fields of a record
+    {
+        if (field_count < 11)      // blank or truncated line
+            return false;
+
+        Market venue = BROKERTEC;       // files without a venue column quote a single venue
+        if (field_count > 11 && !ParseMarket(line_seg[11], venue))
+        {
+            cout << to_simple_string(microsec_clock::local_time()) << "  ERROR: Unknown venue " << line_seg[11] << " skipped.\n";
+            return false;
+        }
+
+        string_view productID = line_seg[0];
+        const V* product = g_bonds.Find(productID);
+        if (product == nullptr)
+        {
+            cout << to_simple_string(microsec_clock::local_time()) << "  ERROR: Unknown product " << productID << " skipped.\n";
+            return false;
+        }
+        long long ticks[10];
+        FractionalToTicks(line_seg + 1, 10, ticks);        // the five bid/offer pairs
+        orderbook = OrderBook<V>(*product, venue);
+        for (int i = 0; i < 5; i++)
+        {
+            orderbook.AddBid(TickPrice(ticks[2 * i]), 1000000 * (i + 1));
+            orderbook.AddOffer(TickPrice(ticks[2 * i + 1]), 1000000 * (i + 1));
+        }
+        return true;
+    }
+
     void Subscribe(string file_name)        // read market data from the given file
     {
-        ifstream in(file_name);
-        int counter = 0;
+        MappedFile in(file_name);
         ptime cur_time;
-        if (in.is_open())
+        if (in.IsOpen())
+        {
+            cur_time = microsec_clock::local_time();
+            cout << to_simple_string(cur_time) << "  Processing order book data from " << file_name << "..." << endl;
+            if (parse_threads > 1 && in.GetSize() > chunk_bytes)
+                ParseParallel(in.GetData());
+            else
+                ParseSequential(in.GetData());
+            cur_time = microsec_clock::local_time();
+            cout << to_simple_string(cur_time) << "  Order book data processed.\n\n";
+        }
+        else
         {
             cur_time = microsec_clock::local_time();
-            cout << cur_time << "  Processing order book data from " << file_name << "..." << endl;
-            string line;
-            
-            double bid_price, offer_price;
-            while (getline(in, line))
+            cout << to_simple_string(cur_time) << "  ERROR: File " << file_name << " can not be opened.\n\n";
+        }
+    }
+
+    void SubscribeBinary(string file_name)      // read market data from a binary feed made by feed_converter
+    {
+        BinaryFeedReader in(file_name, MARKET_DATA_FEED);
+        ptime cur_time;
+        if (in.IsOpen())
+        {
+            cur_time = microsec_clock::local_time();
+            cout << to_simple_string(cur_time) << "  Processing binary order book data from " << file_name << "..." << endl;
+            vector<const V*> products = FindFeedProducts<V>(in);
+            vector<OrderBook<V> > batch;
+            batch.reserve(batch_size);
+            for (uint64_t i = 0; i < in.GetRecordCount(); ++i)
             {
-                ++counter;
-                string seg;
-                vector<string> line_seg;
-                stringstream line_stream(line);
-                while (getline(line_stream, seg, ','))      // parse the comma-separated string
+                const V* product = products[in.GetProduct(i)];
+                if (product == nullptr)
+                    continue;
+                OrderBook<V> orderbook(*product);
+                for (uint32_t j = 0; j < 5; j++)
                 {
-                    line_seg.push_back(seg);
+                    orderbook.AddBid(TickPrice(in.GetTicks(i, 2 * j)), 1000000 * (j + 1));
+                    orderbook.AddOffer(TickPrice(in.GetTicks(i, 2 * j + 1)), 1000000 * (j + 1));
                 }
-                
-                string productID = line_seg[0];
-                if (counter % 1000000 == 0)
+                batch.push_back(orderbook);
+                if (batch.size() == batch_size)
                 {
-                    cur_time = microsec_clock::local_time();
-                    cout << cur_time << "  " << "All order book data processed for " << productID << ".\n";
+                    service->OnMessageBatch(batch);
+                    batch.clear();
                 }
-                V product = Bond(productID, CUSIP, g_tickers[productID], g_coupons[productID], g_dates[productID]);
-                vector<Order> bid_stack, offer_stack;
-                for (int i = 0; i < 5; i++)
+            }
+            if (!batch.empty())
+                service->OnMessageBatch(batch);
+            cur_time = microsec_clock::local_time();
+            cout << to_simple_string(cur_time) << "  Order book data processed.\n\n";
+        }
+        else
+        {
+            cur_time = microsec_clock::local_time();
+            cout << to_simple_string(cur_time) << "  ERROR: File " << file_name << " is not a binary order book feed.\n\n";
+        }
+    }
+
+    void SubscribeSynthetic(const SyntheticFeedOptions& options)      // generate order books in memory, as Generate_Mktdata would write them
+    {
+        ptime cur_time = microsec_clock::local_time();
+        cout << to_simple_string(cur_time) << "  Processing synthetic order book data..." << endl;
+        vector<const V*> products = FindSyntheticProducts<V>(options);
+        uint64_t count = RunSyntheticFeed<OrderBook<V> >(options, "marketdata", batch_size,
+            [&products](SplitMix64& rng, size_t product, uint64_t, uint64_t, OrderBook<V>& orderbook)
+        {
+            int bid[5], offer[5];
+            for (int i = 0; i < 5; i++)
+                RandomBidOffer(rng, bid[i], offer[i]);
+            if (products[product] == nullptr)
+                return false;
+            orderbook = OrderBook<V>(*products[product]);
+            for (int i = 0; i < 5; i++)
+            {
+                orderbook.AddBid(TickPrice(bid[i]), 1000000 * (i + 1));
+                orderbook.AddOffer(TickPrice(offer[i]), 1000000 * (i + 1));
+            }
+            return true;
+        }, [this](vector<OrderBook<V> >& batch) { service->OnMessageBatch(batch); });
+        cur_time = microsec_clock::local_time();
+        cout << to_simple_string(cur_time) << "  " << count << " synthetic order books processed.\n\n";
+    }
+
+    bool ParseDeltaFields(const string_view* line_seg, size_t field_count, OrderBookDelta<V>& delta)       // build a level update from the fields of a record
+    {
+        if (field_count < 7)       // blank or truncated line
+            return false;
+
+        Market venue = BROKERTEC;
+        if (field_count > 7 && !ParseMarket(line_seg[7], venue))
+        {
+            cout << to_simple_string(microsec_clock::local_time()) << "  ERROR: Unknown venue " << line_seg[7] << " skipped.\n";
+            return false;
+        }
+        const V* product = g_bonds.Find(line_seg[0]);
+        if (product == nullptr)
+        {
+            cout << to_simple_string(microsec_clock::local_time()) << "  ERROR: Unknown product " << line_seg[0] << " skipped.\n";
+            return false;
+        }
+        PricingSide side;
+        if (line_seg[2] == "BID")
+            side = BID;
+        else if (line_seg[2] == "OFFER")
+            side = OFFER;
+        else
+            return false;
+        BookAction action;
+        if (line_seg[3] == "INSERT")
+            action = LEVEL_INSERT;
+        else if (line_seg[3] == "UPDATE")
+            action = LEVEL_UPDATE;
+        else if (line_seg[3] == "DELETE")
+            action = LEVEL_DELETE;
+        else
+            return false;
+        uint64_t sequence = 0;
+        from_chars(line_seg[1].data(), line_seg[1].data() + line_seg[1].size(), sequence);
+        delta = OrderBookDelta<V>(*product, venue, sequence, side, action, (uint32_t)FieldToLong(line_seg[4]),
+            TickPrice(FractionalToTicks(line_seg[5])), FieldToLong(line_seg[6]));
+        return true;
+    }
+
+    void SubscribeDeltas(string file_name)      // read level updates of the books from the given file
+    {
+        MappedFile in(file_name);
+        ptime cur_time;
+        if (in.IsOpen())
+        {
+            cur_time = microsec_clock::local_time();
+            cout << to_simple_string(cur_time) << "  Processing order book deltas from " << file_name << "..." << endl;
+            CsvScanner scanner(in.GetData());
+            string_view line, line_seg[8];
+            size_t field_count;
+            OrderBookDelta<V> delta;
+            vector<OrderBookDelta<V> > batch;
+            batch.reserve(batch_size);
+            while (scanner.NextLine(line, line_seg, 8, field_count))
+            {
+                if (!ParseDeltaFields(line_seg, field_count, delta))
+                    continue;
+                batch.push_back(delta);
+                if (batch.size() == batch_size)
                 {
-                    bid_price = FractionalToPrice(line_seg[2 * i + 1]);
-                    offer_price = FractionalToPrice(line_seg[2 * i + 2]);
-                    bid_stack.push_back(Order(bid_price, 1000000 * (i + 1), BID));
-                    offer_stack.push_back(Order(offer_price, 1000000 * (i + 1), OFFER));
+                    service->OnDeltaBatch(batch);
+                    batch.clear();
                 }
-                
-                OrderBook<V> order_book(product, bid_stack, offer_stack);
-                service->OnMessage(order_book);
             }
+            if (!batch.empty())
+                service->OnDeltaBatch(batch);
             cur_time = microsec_clock::local_time();
-            cout << cur_time << "  Order book data processed.\n\n";
+            cout << to_simple_string(cur_time) << "  Order book deltas processed, " << service->GetSequenceGapCount() << " sequence gaps.\n\n";
         }
         else
         {
             cur_time = microsec_clock::local_time();
-            cout << cur_time << "  ERROR: File " << file_name << " can not be opened.\n\n";
+            cout << to_simple_string(cur_time) << "  ERROR: File " << file_name << " can not be opened.\n\n";
         }
     }
+
+private:
+    void ParseSequential(string_view data)      // parse the file on this thread
+    {
+        int counter = 0;
+        CsvScanner scanner(data);
+        string_view line, line_seg[12];
+        size_t field_count;
+        OrderBook<V> orderbook;
+        vector<OrderBook<V> > batch;
+        batch.reserve(batch_size);
+
+        while (scanner.NextLine(line, line_seg, 12, field_count))
+        {
+            ++counter;
+            if (!ParseFields(line_seg, field_count, orderbook))
+                continue;
+            if (counter % 1000000 == 0)
+                PrintProgress(orderbook);
+
+            batch.push_back(orderbook);
+            if (batch.size() == batch_size)
+            {
+                service->OnMessageBatch(batch);
+                batch.clear();
+            }
+        }
+        if (!batch.empty())
+            service->OnMessageBatch(batch);
+    }
+
+    void ParseParallel(string_view data)        // parse chunks of the file on parse_threads workers, deliver them in order
+    {
+        long counter = 0;
+        OrderedChunkParser<OrderBook<V> > parser(data, parse_threads, chunk_bytes);
+        parser.Run([this](string_view chunk, vector<OrderBook<V> >& books)
+        {
+            CsvScanner scanner(chunk);
+            string_view line, line_seg[12];
+            size_t field_count;
+            OrderBook<V> orderbook;
+            while (scanner.NextLine(line, line_seg, 12, field_count))
+            {
+                if (ParseFields(line_seg, field_count, orderbook))
+                    books.push_back(orderbook);
+            }
+        },
+        [this, &counter](vector<OrderBook<V> >& books)
+        {
+            if (books.empty())
+                return;
+            if ((counter + (long)books.size()) / 1000000 != counter / 1000000)
+                PrintProgress(books.back());
+            counter += (long)books.size();
+            service->OnMessageBatch(books);
+        });
+    }
+
+    void PrintProgress(const OrderBook<V>& orderbook)       // report every million books
+    {
+        ptime cur_time = microsec_clock::local_time();
+        cout << to_simple_string(cur_time) << "  " << "All order book data processed for " << orderbook.GetProduct().GetProductId() << ".\n";
+    }
 };
 
 
@@ -411,51 +888,87 @@ public:
         }
     }
 
+    bool ParseLine(string_view line, Inquiry<V>& inquiry)       // parse one inquiry record, false if it is skipped
+    {
+        string_view line_seg[5];
+        return ParseFields(line_seg, SplitFields(line, line_seg, 5), inquiry);
+    }
+
+    bool ParseFields(const string_view* line_seg, size_t field_count, Inquiry<V>& inquiry)      // build an inquiry from the fields of a record
+    {
+        if (field_count < 5)      // blank or truncated line
+            return false;
+
+        string_view productID = line_seg[0];
+        string inquiryID(line_seg[1]);
+        const V* product = g_bonds.Find(productID);
+        if (product == nullptr)
+        {
+            cout << to_simple_string(microsec_clock::local_time()) << "  ERROR: Unknown product " << productID << " skipped.\n";
+            return false;
+        }
+        TickPrice price(FractionalToTicks(line_seg[2]));
+        long quantity = FieldToLong(line_seg[3]);
+        Side side;
+        if (line_seg[4] == "BUY")
+            side = BUY;
+        else
+            side = SELL;
+
+        inquiry = Inquiry<V>(inquiryID, *product, side, quantity, price, RECEIVED);
+        return true;
+    }
+
     void Subscribe(string file_name)
     {
-        ifstream in(file_name);
+        MappedFile in(file_name);
         ptime cur_time;
-        if (in.is_open())
+        if (in.IsOpen())
         {
             cur_time = microsec_clock::local_time();
-            cout << cur_time << "  Processing inquiry data from " << file_name << "..." << endl;
-            string line;
-            vector<string> line_seg;
-
-            string inquiryID, productID;
-            Side side;
-            while (getline(in, line))
+            cout << to_simple_string(cur_time) << "  Processing inquiry data from " << file_name << "..." << endl;
+            CsvScanner scanner(in.GetData());
+            string_view line, line_seg[5];
+            size_t field_count;
+            Inquiry<V> inquiry;
+            while (scanner.NextLine(line, line_seg, 5, field_count))
             {
-                string seg;
-                line_seg.clear();
-                stringstream line_stream(line);
-                while (getline(line_stream, seg, ','))      // parse the comma-separated string
-                {
-                    line_seg.push_back(seg);
-                }
-
-                productID = line_seg[0];
-                inquiryID = line_seg[1];
-                V product = Bond(productID, CUSIP, g_tickers[productID], g_coupons[productID], g_dates[productID]);
-                double price = FractionalToPrice(line_seg[2]);
-                long quantity = stol(line_seg[3]);
-                if (line_seg[4] == "BUY")
-                    side = BUY;
-                else
-                    side = SELL;
-
-                Inquiry<V> inquiry(inquiryID, product, side, quantity, price, RECEIVED);
+                if (!ParseFields(line_seg, field_count, inquiry))
+                    continue;
                 service->OnMessage(inquiry);
             }
             cur_time = microsec_clock::local_time();
-            cout << cur_time << "  Inquiry data processed.\n\n";
+            cout << to_simple_string(cur_time) << "  Inquiry data processed.\n\n";
         }
         else
         {
             cur_time = microsec_clock::local_time();
-            cout << cur_time << "  ERROR: File " << file_name << " can not be opened.\n\n";
+            cout << to_simple_string(cur_time) << "  ERROR: File " << file_name << " can not be opened.\n\n";
         }
     }
+
+    void SubscribeSynthetic(const SyntheticFeedOptions& options)      // generate inquiries in memory, as Generate_Inquiry would write them
+    {
+        ptime cur_time = microsec_clock::local_time();
+        cout << to_simple_string(cur_time) << "  Processing synthetic inquiry data..." << endl;
+        vector<const V*> products = FindSyntheticProducts<V>(options);
+        uint64_t count = RunSyntheticFeed<Inquiry<V> >(options, "inquiries", 1,
+            [&products](SplitMix64& rng, size_t product, uint64_t index, uint64_t event, Inquiry<V>& inquiry)
+        {
+            TickPrice price(RandomPriceTicks(rng));
+            if (products[product] == nullptr)
+                return false;
+            inquiry = Inquiry<V>(SyntheticId("INQUIRYID_", event + 1), *products[product], index % 2 == 0 ? BUY : SELL,
+                (long)(1000000 * (index % 5 + 1)), price, RECEIVED);
+            return true;
+        }, [this](vector<Inquiry<V> >& batch)
+        {
+            for (auto& inquiry : batch)
+                service->OnMessage(inquiry);
+        });
+        cur_time = microsec_clock::local_time();
+        cout << to_simple_string(cur_time) << "  " << count << " synthetic inquiries processed.\n\n";
+    }
 };
 
 
@@ -0,0 +1,244 @@
+
+#ifndef CSV_SCANNER_HPP
+#define CSV_SCANNER_HPP
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CSV_SCANNER_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CSV_TARGET_AVX2
+#else
+#define CSV_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+using namespace std;
+
+// Scans data[pos, size) for ',' and '\n' and writes their offsets to out, which holds at least
+// CSV_SCAN_BLOCK entries more than it is asked to fill. Stops once max_out offsets are written
+// or the data is exhausted, and returns the position up to which data was scanned.
+typedef size_t (*DelimiterScanFn)(const char* data, size_t pos, size_t size, size_t* out, size_t max_out, size_t& count);
+
+// Widest SIMD block a scan kernel consumes at once
+const size_t CSV_SCAN_BLOCK = 32;
+
+// Portable byte-at-a-time kernel
+size_t ScanDelimitersScalar(const char* data, size_t pos, size_t size, size_t* out, size_t max_out, size_t& count);
+
+#ifdef CSV_SCANNER_X86
+// 16 bytes per step, SSE2 is part of every x86-64 host
+size_t ScanDelimitersSSE2(const char* data, size_t pos, size_t size, size_t* out, size_t max_out, size_t& count);
+
+// 32 bytes per step
+CSV_TARGET_AVX2 size_t ScanDelimitersAVX2(const char* data, size_t pos, size_t size, size_t* out, size_t max_out, size_t& count);
+#endif
+
+// Get the fastest kernel the running CPU supports, chosen once per process
+DelimiterScanFn SelectDelimiterScanner();
+
+// Get the name of the kernel SelectDelimiterScanner() picks
+const char* SelectedDelimiterScannerName();
+
+
+/**
+ * Splits comma-separated text into lines and fields.
+ * Delimiters are located a block at a time by a SIMD kernel into a fixed offset buffer, and the
+ * fields are handed out as string_views into the text, so no allocation happens per line.
+ * Field semantics match getline() on a stringstream: a trailing comma does not start an empty
+ * field, and "\r\n" line endings are accepted.
+ */
+class CsvScanner
+{
+public:
+    // ctor for a scanner over the data, using the kernel picked for this CPU by default
+    CsvScanner(string_view _data, DelimiterScanFn _scan = SelectDelimiterScanner());
+
+    // Get the next line and its first max_fields fields, returns false once the data is exhausted
+    bool NextLine(string_view& line, string_view* fields, size_t max_fields, size_t& field_count);
+
+private:
+    static const size_t capacity = 4096;
+
+    string_view data;
+    DelimiterScanFn scan;
+    size_t pos;                 // start of the next line
+    size_t scan_pos;            // data before this has been scanned
+    size_t offsets[capacity + CSV_SCAN_BLOCK];
+    size_t offset_count;
+    size_t next_offset;
+
+    // Scan the next block of data, returns false if no delimiters are left
+    bool Refill();
+};
+
+
+size_t ScanDelimitersScalar(const char* data, size_t pos, size_t size, size_t* out, size_t max_out, size_t& count)
+{
+    count = 0;
+    while (pos < size && count < max_out)
+    {
+        char c = data[pos];
+        if (c == ',' || c == '\n')
+            out[count++] = pos;
+        ++pos;
+    }
+    return pos;
+}
+
+#ifdef CSV_SCANNER_X86
+
+// Get the index of the lowest set bit of a non-zero mask
+inline unsigned LowestBit(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned)index;
+#else
+    return (unsigned)__builtin_ctz(mask);
+#endif
+}
+
+size_t ScanDelimitersSSE2(const char* data, size_t pos, size_t size, size_t* out, size_t max_out, size_t& count)
+{
+    count = 0;
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (pos + 16 <= size && count < max_out)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)(data + pos));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, comma), _mm_cmpeq_epi8(block, newline)));
+        while (mask != 0)
+        {
+            out[count++] = pos + LowestBit(mask);
+            mask &= mask - 1;
+        }
+        pos += 16;
+    }
+    if (count >= max_out)
+        return pos;
+    size_t tail_count;
+    pos = ScanDelimitersScalar(data, pos, size, out + count, max_out - count, tail_count);
+    count += tail_count;
+    return pos;
+}
+
+CSV_TARGET_AVX2 size_t ScanDelimitersAVX2(const char* data, size_t pos, size_t size, size_t* out, size_t max_out, size_t& count)
+{
+    count = 0;
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    while (pos + 32 <= size && count < max_out)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i*)(data + pos));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(block, comma), _mm256_cmpeq_epi8(block, newline)));
+        while (mask != 0)
+        {
+            out[count++] = pos + LowestBit(mask);
+            mask &= mask - 1;
+        }
+        pos += 32;
+    }
+    if (count >= max_out)
+        return pos;
+    size_t tail_count;
+    pos = ScanDelimitersScalar(data, pos, size, out + count, max_out - count, tail_count);
+    count += tail_count;
+    return pos;
+}
+
+// Whether the CPU and the OS support AVX2
+inline bool HasAVX2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+DelimiterScanFn SelectDelimiterScanner()
+{
+#ifdef CSV_SCANNER_X86
+    static const DelimiterScanFn scanner = HasAVX2() ? ScanDelimitersAVX2 : ScanDelimitersSSE2;
+    return scanner;
+#else
+    return ScanDelimitersScalar;
+#endif
+}
+
+const char* SelectedDelimiterScannerName()
+{
+#ifdef CSV_SCANNER_X86
+    return SelectDelimiterScanner() == ScanDelimitersAVX2 ? "avx2" : "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+
+CsvScanner::CsvScanner(string_view _data, DelimiterScanFn _scan) :
+    data(_data), scan(_scan), pos(0), scan_pos(0), offset_count(0), next_offset(0)
+{
+}
+
+bool CsvScanner::NextLine(string_view& line, string_view* fields, size_t max_fields, size_t& field_count)
+{
+    field_count = 0;
+    if (pos >= data.size())
+        return false;
+
+    size_t field_start = pos;
+    size_t line_end = data.size();
+    size_t next_pos = data.size();
+    while (next_offset < offset_count || Refill())
+    {
+        size_t d = offsets[next_offset++];
+        if (data[d] == '\n')
+        {
+            line_end = d;
+            next_pos = d + 1;
+            break;
+        }
+        if (field_count < max_fields)
+            fields[field_count++] = data.substr(field_start, d - field_start);
+        field_start = d + 1;
+    }
+
+    if (line_end > pos && data[line_end - 1] == '\r')
+        --line_end;
+    if (field_start < line_end && field_count < max_fields)
+        fields[field_count++] = data.substr(field_start, line_end - field_start);
+    line = data.substr(pos, line_end - pos);
+    pos = next_pos;
+    return true;
+}
+
+bool CsvScanner::Refill()
+{
+    next_offset = 0;
+    offset_count = 0;
+    while (offset_count == 0 && scan_pos < data.size())
+        scan_pos = scan(data.data(), scan_pos, data.size(), offsets, capacity, offset_count);
+    return offset_count > 0;
+}
+
+#endif
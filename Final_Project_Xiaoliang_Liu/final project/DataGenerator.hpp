@@ -6,11 +6,16 @@
 #include <vector>
 #include <map>
 #include <string>
-#include <random>
+#include <cstdint>
+#include <cstring>
+#include <charconv>
+#include <thread>
 #include <iostream>
 #include <fstream>
 #include <boost/date_time.hpp>
 #include "boost/date_time/gregorian/gregorian.hpp"
+#include "Products.hpp"
+#include "OrderedChunkParser.hpp"
 
 using namespace std;
 using namespace boost::gregorian;
@@ -38,205 +43,359 @@ map<string, date> g_dates = { {"OTRUSTR_02Y",date(2024,12,31)}, {"OTRUSTR_03Y",d
 vector<string> books{ "TRSY1","TRSY2","TRSY3" };
 
 
-// Generate trades.txt
-void Generate_Trades(string file_name)
+// Look up reference data for a product without inserting into the map,
+// so connectors running on different threads can share the maps above
+template<typename M>
+typename M::mapped_type LookupRefData(const M& ref_data, const string& productId)
+{
+	auto it = ref_data.find(productId);
+	if (it == ref_data.end())
+		return typename M::mapped_type();
+	return it->second;
+}
+
+
+// Catalog of the bonds above, built once by LoadBondCatalog() and shared by all events
+ProductCatalog<Bond> g_bonds;
+
+// Build the bond catalog from the reference data maps
+void LoadBondCatalog()
+{
+	for (auto& productId : g_product_Ids)
+	{
+		g_bonds.Add(Bond(productId, CUSIP, LookupRefData(g_tickers, productId), LookupRefData(g_coupons, productId),
+			LookupRefData(g_dates, productId)));
+	}
+}
+
+
+/*
+* The generators below shard each file into chunks of lines, product by product, and format the
+* chunks on a pool of threads, each into its own buffer. The chunks are written in order, so a file
+* lists its products in catalog order as before. Every chunk draws from its own generator, seeded
+* from the run's seed, the file and the chunk's position, so a seed always gives the same files
+* whatever the number of threads.
+*/
+
+// Settings shared by the generators, main() fills them from the command line
+struct GeneratorOptions
+{
+	uint64_t seed = 1;
+	size_t threads = 0;				// 0 for one per core
+	size_t product_count = 7;		// the first products of g_product_Ids to generate data for
+};
+
+GeneratorOptions g_generator_options;
+
+// Lines generated by one task
+const size_t GENERATOR_CHUNK_LINES = 1 << 16;
+
+// Longest line any generator writes
+const size_t GENERATOR_MAX_LINE = 128;
+
+
+/**
+ * SplitMix64, a small and fast pseudo-random generator with a 64-bit state.
+ */
+class SplitMix64
+{
+public:
+	// ctor for a generator with a seed
+	explicit SplitMix64(uint64_t _state);
+
+	// Get the next 64 random bits
+	uint64_t Next();
+
+	// Get a random number below n
+	uint32_t Below(uint32_t n);
+
+private:
+	uint64_t state;
+};
+
+SplitMix64::SplitMix64(uint64_t _state) : state(_state)
+{
+}
+
+uint64_t SplitMix64::Next()
+{
+	uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+uint32_t SplitMix64::Below(uint32_t n)
+{
+	return (uint32_t)(((Next() >> 32) * n) >> 32);
+}
+
+
+// Write an integer in decimal
+inline char* AppendInt(char* out, long long value)
+{
+	return to_chars(out, out + 20, value).ptr;
+}
+
+// Write a fixed text
+inline char* AppendText(char* out, const string& text)
+{
+	memcpy(out, text.data(), text.size());
+	return out + text.size();
+}
+
+// Get a random price from 99-000 to 100-317 in 1/256 ticks
+inline int RandomPriceTicks(SplitMix64& rng)
+{
+	int n1 = rng.Below(2) + 99;
+	int n2 = rng.Below(32);
+	int n3 = rng.Below(8);
+	return n1 * 256 + n2 * 8 + n3;
+}
+
+// Get two random prices, the lower one as the bid
+inline void RandomBidOffer(SplitMix64& rng, int& bid, int& offer)
+{
+	bid = RandomPriceTicks(rng);
+	offer = RandomPriceTicks(rng);
+	if (bid > offer)
+		swap(bid, offer);
+}
+
+// Write a price in 1/256 ticks in fractional notation
+inline char* AppendFractional(char* out, int ticks)
+{
+	int n2 = ticks % 256 / 8;
+	int n3 = ticks % 8;
+	out = AppendInt(out, ticks / 256);
+	*out++ = '-';
+	*out++ = (char)('0' + n2 / 10);
+	*out++ = (char)('0' + n2 % 10);
+	*out++ = n3 == 4 ? '+' : (char)('0' + n3);
+	return out;
+}
+
+// Write two random prices, the lower one first
+inline void AppendRandomBidOffer(char*& out, SplitMix64& rng)
+{
+	int bid, offer;
+	RandomBidOffer(rng, bid, offer);
+	out = AppendFractional(out, bid);
+	*out++ = ',';
+	out = AppendFractional(out, offer);
+}
+
+// Get the seed of a chunk of a file, or of any other stream of random data
+inline uint64_t ChunkSeed(uint64_t seed, const string& file_kind, size_t product, size_t chunk)
+{
+	seed = SplitMix64(seed).Next();
+	for (char c : file_kind)
+		seed = SplitMix64(seed ^ (uint8_t)c).Next();
+	seed = SplitMix64(seed ^ product).Next();
+	return SplitMix64(seed ^ chunk).Next();
+}
+
+// Generate a file of count_per_product lines for each product in parallel chunks.
+// format_line(char* out, SplitMix64& rng, size_t product, size_t line) writes a line and returns
+// its end; done(product) runs once a product's lines are all written.
+template<typename Format, typename Done>
+void GenerateFile(const string& file_name, const string& file_kind, int count_per_product, Format format_line, Done done)
+{
+	struct Chunk
+	{
+		string text;
+		size_t size = 0;
+		size_t product = 0;
+		bool last = false;		// last chunk of its product
+	};
+
+	size_t products = min(g_generator_options.product_count, g_product_Ids.size());
+	size_t lines = count_per_product > 0 ? count_per_product : 0;
+	size_t chunks_per_product = (lines + GENERATOR_CHUNK_LINES - 1) / GENERATOR_CHUNK_LINES;
+	size_t threads = g_generator_options.threads > 0 ? g_generator_options.threads : thread::hardware_concurrency();
+
+	ofstream out(file_name);
+	RunOrdered<Chunk>(products * chunks_per_product, threads, [&](size_t task, Chunk& chunk)
+	{
+		chunk.product = task / chunks_per_product;
+		size_t index = task % chunks_per_product;
+		size_t first = index * GENERATOR_CHUNK_LINES;
+		size_t count = min(GENERATOR_CHUNK_LINES, lines - first);
+		chunk.last = index + 1 == chunks_per_product;
+		if (chunk.text.size() < count * GENERATOR_MAX_LINE)
+			chunk.text.resize(count * GENERATOR_MAX_LINE);
+
+		SplitMix64 rng(ChunkSeed(g_generator_options.seed, file_kind, chunk.product, index));
+		char* p = &chunk.text[0];
+		for (size_t j = first; j < first + count; ++j)
+			p = format_line(p, rng, chunk.product, j);
+		chunk.size = p - chunk.text.data();
+	}, [&](Chunk& chunk)
+	{
+		out.write(chunk.text.data(), chunk.size);
+		if (chunk.last)
+			done(chunk.product);
+	});
+	out.close();
+}
+
+
+// Generate trades.txt with count_per_product records for each product
+void Generate_Trades(string file_name, int count_per_product = 10)
 {
 	boost::posix_time::ptime cur_time = boost::posix_time::microsec_clock::local_time();
 	cout << cur_time << "  Generating trade data in " << file_name << "...\n";
 
 	vector<string> sides{ "BUY","SELL" };
-	ofstream out(file_name);
-	int counter = 0;
-	for (int i = 0; i < 7; ++i)
+	GenerateFile(file_name, "trades", count_per_product, [&](char* out, SplitMix64& rng, size_t product, size_t j)
 	{
-		string productId = g_product_Ids[i];
-		for (int j = 0; j < 10; ++j)
-		{
-			++counter;
-			out << productId << ",TRADEID_";		
-			if (counter < 10)
-				out << "0" << to_string(counter) << ",";
-			else
-				out << to_string(counter) << ",";		
-			out << books[(counter - 1) % 3] << ",";		
-
-			int n1 = rand() % 2 + 99;
-			int n2 = rand() % 32;
-			int n3 = rand() % 8;
-			string s1 = to_string(n1);
-			string s2 = to_string(n2);
-			string s3 = to_string(n3);
-			if (n2 < 10)
-				s2 = "0" + s2;
-			if (n3 == 4)
-				s3 = "+";
-			string price = s1 + "-" + s2 + s3;
-			out << price << ",";
-
-			out << 1000000 * (j % 5 + 1) << "," << sides[j % 2] << endl;
-		}
-	}
-	out.close();
+		long long counter = (long long)(product * count_per_product + j + 1);
+		out = AppendText(out, g_product_Ids[product]);
+		out = AppendText(out, ",TRADEID_");
+		if (counter < 10)
+			*out++ = '0';
+		out = AppendInt(out, counter);
+		*out++ = ',';
+		out = AppendText(out, books[(counter - 1) % 3]);
+		*out++ = ',';
+		out = AppendFractional(out, RandomPriceTicks(rng));
+		*out++ = ',';
+		out = AppendInt(out, 1000000 * (j % 5 + 1));
+		*out++ = ',';
+		out = AppendText(out, sides[j % 2]);
+		*out++ = '\n';
+		return out;
+	}, [](size_t) {});
 	cur_time = boost::posix_time::microsec_clock::local_time();
 	cout << cur_time << "  Trade data generated.\n\n";
 }
 
 
-// Generate prices.txt
-void Generate_Prices(string file_name)
+// Generate prices.txt with count_per_product records for each product
+void Generate_Prices(string file_name, int count_per_product = 1000000)
 {
 	boost::posix_time::ptime cur_time = boost::posix_time::microsec_clock::local_time();
 	cout << cur_time << "  Generating price data in " << file_name << "...\n";
 
-	ofstream out(file_name);
-	for (int i = 0; i < 7; ++i)
+	GenerateFile(file_name, "prices", count_per_product, [](char* out, SplitMix64& rng, size_t product, size_t)
 	{
-		string productId = g_product_Ids[i];
-		for (int j = 0; j < 1000000; ++j)
-		{
-			out << productId << ",";
-			
-			int n1 = rand() % 2 + 99;
-			int n2 = rand() % 32;
-			int n3 = rand() % 8;
-			double v1 = n1 + n2 * 1.0 / 32.0 + n3 * 1.0 / 252.0;
-			string s1 = to_string(n1);
-			string s2 = to_string(n2);
-			string s3 = to_string(n3);
-			if (n2 < 10)
-				s2 = "0" + s2;
-			if (n3 == 4)
-				s3 = "+";
-			string price1 = s1 + "-" + s2 + s3;
-
-			n1 = rand() % 2 + 99;
-			n2 = rand() % 32;
-			n3 = rand() % 8;
-			s1 = to_string(n1);
-			s2 = to_string(n2);
-			s3 = to_string(n3);
-			if (n2 < 10)
-				s2 = "0" + s2;
-			if (n3 == 4)
-				s3 = "+";
-			double v2 = n1 + n2 * 1.0 / 32.0 + n3 * 1.0 / 252.0;
-			string price2 = s1 + "-" + s2 + s3;
-			
-			if (v1 > v2)
-				out << price2 << "," << price1 << endl;
-			else
-				out << price1 << "," << price2 << endl;
-
-		}
-		cur_time = boost::posix_time::microsec_clock::local_time();
-		cout << cur_time << "  All prices generated for " << productId << endl;
-	}
-	out.close();
+		out = AppendText(out, g_product_Ids[product]);
+		*out++ = ',';
+		AppendRandomBidOffer(out, rng);
+		*out++ = '\n';
+		return out;
+	}, [](size_t product)
+	{
+		boost::posix_time::ptime cur_time = boost::posix_time::microsec_clock::local_time();
+		cout << cur_time << "  All prices generated for " << g_product_Ids[product] << endl;
+	});
 	cur_time = boost::posix_time::microsec_clock::local_time();
 	cout << cur_time << "  Price data generated.\n\n";
 }
 
 
-// Generate marketdata.txt
-void Generate_Mktdata(string file_name)
+// Generate marketdata.txt with count_per_product records for each product
+void Generate_Mktdata(string file_name, int count_per_product = 1000000)
 {
 	boost::posix_time::ptime cur_time = boost::posix_time::microsec_clock::local_time();
 	cout << cur_time << "  Generating order book data in " << file_name << "...\n";
 
-	ofstream out(file_name);
-	for (int i = 0; i < 7; ++i)
+	GenerateFile(file_name, "marketdata", count_per_product, [](char* out, SplitMix64& rng, size_t product, size_t)
 	{
-		string productId = g_product_Ids[i];
-		for (int j = 0; j < 1000000; ++j)
+		out = AppendText(out, g_product_Ids[product]);
+		*out++ = ',';
+		for (int level = 1; level <= 5; ++level)
 		{
-			out << productId << ",";
-			int n1, n2, n3;
-			double v1, v2;
-			string s1, s2, s3;
-			for (int j = 1; j <= 5; ++j)
-			{
-				n1 = rand() % 2 + 99;
-				n2 = rand() % 32;
-				n3 = rand() % 8;
-				v1 = n1 + n2 * 1.0 / 32.0 + n3 * 1.0 / 252.0;
-				s1 = to_string(n1);
-				s2 = to_string(n2);
-				s3 = to_string(n3);
-				if (n2 < 10)
-					s2 = "0" + s2;
-				if (n3 == 4)
-					s3 = "+";
-				string price1 = s1 + "-" + s2 + s3;
-
-				n1 = rand() % 2 + 99;
-				n2 = rand() % 32;
-				n3 = rand() % 8;
-				v2 = n1 + n2 * 1.0 / 32.0 + n3 * 1.0 / 252.0;
-				s1 = to_string(n1);
-				s2 = to_string(n2);
-				s3 = to_string(n3);
-				if (n2 < 10)
-					s2 = "0" + s2;
-				if (n3 == 4)
-					s3 = "+";
-				string price2 = s1 + "-" + s2 + s3;
-
-				if (v1 > v2)
-					out << price2 << "," << price1 << ",";
-				else
-					out << price1 << "," << price2 << ",";
-			}
-			out << endl;
+			AppendRandomBidOffer(out, rng);
+			*out++ = ',';
 		}
-		cur_time = boost::posix_time::microsec_clock::local_time();
-		cout << cur_time << "  All order book data generated for " << productId << endl;
-	}
-	out.close();
+		*out++ = '\n';
+		return out;
+	}, [](size_t product)
+	{
+		boost::posix_time::ptime cur_time = boost::posix_time::microsec_clock::local_time();
+		cout << cur_time << "  All order book data generated for " << g_product_Ids[product] << endl;
+	});
 	cur_time = boost::posix_time::microsec_clock::local_time();
 	cout << cur_time << "  Order book data generated.\n\n";
 }
 
 
-// Generate inquiries.txt
-void Generate_Inquiry(string file_name)
+// Generate marketdata_deltas.txt with count_per_product level updates for each product:
+// product, sequence, side, action, level, price, quantity. The first ten build five levels a
+// side, then each side in turn gets a delete, an insert and an update of a random level, so a
+// side never holds fewer than four levels. Sequence numbers start at 1 for each product.
+void Generate_MktdataDeltas(string file_name, int count_per_product = 1000000)
 {
 	boost::posix_time::ptime cur_time = boost::posix_time::microsec_clock::local_time();
-	cout << cur_time << "  Generating inquiry data in " << file_name << "...\n";
+	cout << cur_time << "  Generating order book deltas in " << file_name << "...\n";
 
-	vector<string> sides{ "BUY","SELL" };
-	ofstream out(file_name);
-	int counter = 0;
-	for (int i = 0; i < 7; ++i)
+	GenerateFile(file_name, "marketdata deltas", count_per_product, [](char* out, SplitMix64& rng, size_t product, size_t j)
 	{
-		string productId = g_product_Ids[i];
-		for (int j = 0; j < 10; ++j)
+		static const char* const actions[3] = { "DELETE", "INSERT", "UPDATE" };
+		bool bid_side;
+		const char* action;
+		int level;
+		if (j < 10)
 		{
-			++counter;
-			out << productId << ",INQUIRYID_";
-			if (counter < 10)
-				out << "0" << to_string(counter) << ",";
-			else
-				out << to_string(counter) << ",";
-
-			int n1 = rand() % 2 + 99;
-			int n2 = rand() % 32;
-			int n3 = rand() % 8;
-			string s1 = to_string(n1);
-			string s2 = to_string(n2);
-			string s3 = to_string(n3);
-			if (n2 < 10)
-				s2 = "0" + s2;
-			if (n3 == 4)
-				s3 = "+";
-			string price = s1 + "-" + s2 + s3;
-			out << price << ",";
-
-			out << 1000000 * (j % 5 + 1) << "," << sides[j % 2] << ",RECEIVED" << endl;
+			bid_side = j % 2 == 0;
+			action = "INSERT";
+			level = (int)(j / 2);
 		}
-	}
-	out.close();
+		else
+		{
+			bid_side = (j - 10) / 3 % 2 == 0;
+			action = actions[(j - 10) % 3];
+			level = (int)rng.Below(5);
+		}
+		int bid, offer;
+		RandomBidOffer(rng, bid, offer);
+
+		out = AppendText(out, g_product_Ids[product]);
+		*out++ = ',';
+		out = AppendInt(out, (long long)j + 1);
+		out = AppendText(out, bid_side ? ",BID," : ",OFFER,");
+		out = AppendText(out, action);
+		*out++ = ',';
+		out = AppendInt(out, level);
+		*out++ = ',';
+		out = AppendFractional(out, bid_side ? bid : offer);
+		*out++ = ',';
+		out = AppendInt(out, 1000000LL * (level + 1));
+		*out++ = '\n';
+		return out;
+	}, [](size_t) {});
+	cur_time = boost::posix_time::microsec_clock::local_time();
+	cout << cur_time << "  Order book deltas generated.\n\n";
+}
+
+
+// Generate inquiries.txt with count_per_product records for each product
+void Generate_Inquiry(string file_name, int count_per_product = 10)
+{
+	boost::posix_time::ptime cur_time = boost::posix_time::microsec_clock::local_time();
+	cout << cur_time << "  Generating inquiry data in " << file_name << "...\n";
+
+	vector<string> sides{ "BUY","SELL" };
+	GenerateFile(file_name, "inquiries", count_per_product, [&](char* out, SplitMix64& rng, size_t product, size_t j)
+	{
+		long long counter = (long long)(product * count_per_product + j + 1);
+		out = AppendText(out, g_product_Ids[product]);
+		out = AppendText(out, ",INQUIRYID_");
+		if (counter < 10)
+			*out++ = '0';
+		out = AppendInt(out, counter);
+		*out++ = ',';
+		out = AppendFractional(out, RandomPriceTicks(rng));
+		*out++ = ',';
+		out = AppendInt(out, 1000000 * (j % 5 + 1));
+		*out++ = ',';
+		out = AppendText(out, sides[j % 2]);
+		out = AppendText(out, ",RECEIVED\n");
+		return out;
+	}, [](size_t) {});
 	cur_time = boost::posix_time::microsec_clock::local_time();
 	cout << cur_time << "  Trade data generated.\n\n";
 }
 
-#endif
\ No newline at end of file
+#endif
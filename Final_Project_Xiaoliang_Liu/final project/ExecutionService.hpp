@@ -6,25 +6,26 @@
 #include <string>
 #include <map>
 #include "SOA.hpp"
+#include "Products.hpp"
 #include "MarketDataService.hpp"
+#include "TickPrice.hpp"
 
 enum OrderType { FOK, IOC, MARKET, LIMIT, STOP };
 
-enum Market { BROKERTEC, ESPEED, CME };
-
 /**
  * An execution order that can be placed on an exchange.
+ * The order carries the venue it is routed to, the one quoting the book it was priced from.
  * Type T is the product type.
  */
 template<typename T>
 class ExecutionOrder
 {
 public:
-    // ctor for an order
+    // ctor for an order, the product is referenced and must outlive the order
     ExecutionOrder() = default;
     ExecutionOrder(const T& _product, PricingSide _side, string _orderId, OrderType _orderType,
-        double _price, double _visibleQuantity, double _hiddenQuantity, string _parentOrderId,
-        bool _isChildOrder);
+        TickPrice _price, double _visibleQuantity, double _hiddenQuantity, string _parentOrderId,
+        bool _isChildOrder, Market _venue = BROKERTEC);
 
     // Get the product
     const T& GetProduct() const;
@@ -36,7 +37,7 @@ public:
     OrderType GetOrderType() const;
 
     // Get the price on this order
-    double GetPrice() const;
+    TickPrice GetPrice() const;
 
     // Get the visible quantity on this order
     double GetVisibleQuantity() const;
@@ -52,47 +53,60 @@ public:
 
     // get pricing side
     PricingSide GetPricingSide() const;
+
+    // Get the venue the order is routed to
+    Market GetVenue() const;
+
+    // Route the order to a venue
+    void SetVenue(Market _venue);
     
 private:
-    T product;
+    const T* product = nullptr;
     PricingSide side;
     string orderId;
     OrderType orderType;
-    double price;
+    TickPrice price;
     double visibleQuantity;
     double hiddenQuantity;
     string parentOrderId;
     bool isChildOrder;
+    Market venue = BROKERTEC;
 };
 
 
 /**
  * Service for executing orders on an exchange.
- * Keyed on product identifier.
- * Type T is the product type.
+ * Keyed on product identifier, stored by product index.
+ * Type T is the product type, Chain the compile-time listener chain.
  */
-template<typename T>
-class ExecutionService : public Service<string, ExecutionOrder <T> >
+template<typename T, typename Chain = ListenerChain<ExecutionOrder<T> > >
+class ExecutionService : public Service<string, ExecutionOrder <T>, Chain>
 {
 private:
-    map<string, ExecutionOrder<T>> execution_orders;
+    ProductTable<ExecutionOrder<T> > execution_orders;
 
 public:
     // Get data on our service given a key
     ExecutionOrder<T>& GetData(string key);
 
+    // Get data on our service given a product index
+    ExecutionOrder<T>& GetData(int productIndex);
+
     // The callback that a Connector should invoke for any new or updated data
     void OnMessage(ExecutionOrder<T>& data);
 
-    // Execute an order on a market
+    // Execute an order on a market, the order is routed there
     void ExecuteOrder(ExecutionOrder<T>& order, Market market);
+
+    // Execute a block of orders, each on the venue it is routed to
+    void ExecuteOrderBatch(vector<ExecutionOrder<T> >& orders);
     
 };
 
 
 template<typename T>
-ExecutionOrder<T>::ExecutionOrder(const T& _product, PricingSide _side, string _orderId, OrderType _orderType, double _price, double _visibleQuantity, double _hiddenQuantity, string _parentOrderId, bool _isChildOrder) :
-    product(_product)
+ExecutionOrder<T>::ExecutionOrder(const T& _product, PricingSide _side, string _orderId, OrderType _orderType, TickPrice _price, double _visibleQuantity, double _hiddenQuantity, string _parentOrderId, bool _isChildOrder, Market _venue) :
+    product(&_product), venue(_venue)
 {
     side = _side;
     orderId = _orderId;
@@ -108,7 +122,7 @@ ExecutionOrder<T>::ExecutionOrder(const T& _product, PricingSide _side, string _
 template<typename T>
 const T& ExecutionOrder<T>::GetProduct() const
 {
-    return product;
+    return *product;
 }
 template<typename T>
 const string& ExecutionOrder<T>::GetOrderId() const
@@ -123,7 +137,7 @@ OrderType ExecutionOrder<T>::GetOrderType() const
 }
 
 template<typename T>
-double ExecutionOrder<T>::GetPrice() const
+TickPrice ExecutionOrder<T>::GetPrice() const
 {
     return price;
 }
@@ -158,24 +172,51 @@ PricingSide ExecutionOrder<T>::GetPricingSide() const
     return side;
 }
 
+template <typename T>
+Market ExecutionOrder<T>::GetVenue() const
+{
+    return venue;
+}
 
 template <typename T>
-ExecutionOrder<T>& ExecutionService<T>::GetData(string key)
+void ExecutionOrder<T>::SetVenue(Market _venue)
+{
+    venue = _venue;
+}
+
+
+template <typename T, typename Chain>
+ExecutionOrder<T>& ExecutionService<T, Chain>::GetData(string key)
 {
     return execution_orders[key];
 }
 
-template <typename T>
-void ExecutionService<T>::OnMessage(ExecutionOrder<T>& data)
+template <typename T, typename Chain>
+ExecutionOrder<T>& ExecutionService<T, Chain>::GetData(int productIndex)
 {
-    execution_orders[data.GetProduct().GetProductId()] = data;
+    return execution_orders[productIndex];
 }
 
-template <typename T>
-void ExecutionService<T>::ExecuteOrder(ExecutionOrder<T>& order, Market market)
+template <typename T, typename Chain>
+void ExecutionService<T, Chain>::OnMessage(ExecutionOrder<T>& data)
+{
+    execution_orders[data.GetProduct().GetProductIndex()] = data;
+}
+
+template <typename T, typename Chain>
+void ExecutionService<T, Chain>::ExecuteOrder(ExecutionOrder<T>& order, Market market)
+{
+    order.SetVenue(market);
+    execution_orders[order.GetProduct().GetProductIndex()] = order;
+    Service<string, ExecutionOrder <T>, Chain>::Notify(order);
+}
+
+template <typename T, typename Chain>
+void ExecutionService<T, Chain>::ExecuteOrderBatch(vector<ExecutionOrder<T> >& orders)
 {
-    execution_orders[order.GetProduct().GetProductId()] = order;
-    Service<string, ExecutionOrder <T> >::Notify(order);
+    for (auto& e : orders)
+        execution_orders[e.GetProduct().GetProductIndex()] = e;
+    Service<string, ExecutionOrder <T>, Chain>::NotifyBatch(orders);
 }
 
 #endif
@@ -1,5 +1,3 @@
-
-
 #ifndef GUISERVICE_HPP
 #define GUISERVICE_HPP
 
@@ -9,49 +7,80 @@
 #include "SOA.hpp"
 #include "PricingService.hpp"
 #include "Connectors.hpp"
+#include "SeqLock.hpp"
+#include "TimerService.hpp"
 
 using namespace std;
 using namespace boost::posix_time;
 
 
+/**
+ * GUI Service publishing prices to the GUI at a throttled rate.
+ * OnMessage only keeps the latest price; a timer on the timer service publishes it once per
+ * throttle period if it changed, on the timer service's thread, so no tick reads the clock.
+ * Stop() publishes a price still waiting for its period, so the last one always gets out.
+ * Type T is the product type.
+ */
 template<typename T>
 class GUIService : public Service<string, Price<T> >
 {
 private:
-    map<string, Price<T>> guis;
+    ProductTable<Price<T> > guis;
     GUIConnector<T>* connector;
-    ptime last_time;
-    time_duration throttle;
+    TimerService* timers;
+    TimerId throttle_timer;
+    SeqLock<Price<T> > latest;          // written by OnMessage, read by the throttle timer
+    uint64_t published_version;         // version of latest published last
+
+    // Publish the latest price if a new one arrived since the last call
+    void PublishLatest();
 
 public:
-    // ctor
-    GUIService();
-    GUIService(GUIConnector<T>* _connector);
+    // ctor, publishes at most one price per throttle period
+    GUIService(TimerService* _timers, time_duration _throttle = millisec(300));
+    GUIService(TimerService* _timers, GUIConnector<T>* _connector, time_duration _throttle = millisec(300));
+    ~GUIService();
+
+    // Stop the throttle and publish the latest price if it is not published yet, nothing is
+    // published after. Called by the dtor if not before.
+    void Stop();
     
     // Get data on our service given a key
     Price<T>& GetData(string key);
 
+    // Get data on our service given a product index
+    Price<T>& GetData(int productIndex);
+
     // The callback that a Connector should invoke for any new or updated data
     void OnMessage(Price<T>& data);
 };
 
 
 template <typename T>
-GUIService<T>::GUIService()
+GUIService<T>::GUIService(TimerService* _timers, time_duration _throttle) :
+    GUIService(_timers, new GUIConnector<T>, _throttle)
 {
-    guis = map<string, Price<T>>();
-    connector = new GUIConnector<T>;
-    last_time = microsec_clock::local_time();
-    throttle = millisec(300);
 }
 
 template <typename T>
-GUIService<T>::GUIService(GUIConnector<T>* _connector)
+GUIService<T>::GUIService(TimerService* _timers, GUIConnector<T>* _connector, time_duration _throttle) :
+    connector(_connector), timers(_timers), published_version(0)
 {
-    guis = map<string, Price<T>>();
-    connector = _connector;
-    last_time = microsec_clock::local_time();
-    throttle = millisec(300);
+    throttle_timer = timers->ScheduleEvery(_throttle, [this]() { PublishLatest(); });
+}
+
+template <typename T>
+GUIService<T>::~GUIService()
+{
+    Stop();
+}
+
+template <typename T>
+void GUIService<T>::Stop()
+{
+    // waits for a throttle callback running on the timer thread
+    timers->Cancel(throttle_timer);
+    PublishLatest();
 }
 
 template <typename T>
@@ -60,16 +89,29 @@ Price<T>& GUIService<T>::GetData(string key)
     return guis[key];
 }
 
+template <typename T>
+Price<T>& GUIService<T>::GetData(int productIndex)
+{
+    return guis[productIndex];
+}
+
 template <typename T>
 void GUIService<T>::OnMessage(Price<T>& data)
 {
-    //guis[data.GetProduct().GetProductId()] = data;
-    ptime now = microsec_clock::local_time();
-    if (now - last_time > throttle)
-    {
-        last_time = now;
-        connector->Publish(data);
-    }
+    SOA_LATENCY_SCOPE("GUIService::OnMessage");
+    //guis[data.GetProduct().GetProductIndex()] = data;
+    latest.Store(data);
+}
+
+template <typename T>
+void GUIService<T>::PublishLatest()
+{
+    uint64_t version;
+    Price<T> price = latest.Load(version);
+    if (version == published_version)
+        return;
+    published_version = version;
+    connector->Publish(price);
 }
 
-#endif 
\ No newline at end of file
+#endif
@@ -4,6 +4,7 @@
 #define HISTORICAL_DATA_SERVICE_HPP
 
 #include <string>
+#include <vector>
 #include "SOA.hpp"
 #include "Products.hpp"
 #include "Connectors.hpp"
@@ -12,6 +13,7 @@
 #include "StreamingService.hpp"
 #include "InquiryService.hpp"
 #include "ExecutionService.hpp"
+#include "MarketDataService.hpp"
 
 template<typename T>
 class HistoricalDataService : Service<string, T>
@@ -45,7 +47,7 @@ private:
     
 public:
     // ctor
-    HistoricalPositionService() = default;
+    HistoricalPositionService() : connector(new HistoricalPositionConnector<V>) {}
     HistoricalPositionService(HistoricalPositionConnector<V>* _connector): connector(_connector) {}
 
     // Persist data to a store
@@ -53,6 +55,12 @@ public:
     {
         connector->Publish(data);
     }
+
+    // Persist a block of data to a store
+    void PersistDataBatch(vector<Position<V> >& data)
+    {
+        connector->PublishBatch(data);
+    }
 };
 
 
@@ -67,7 +75,7 @@ private:
 
 public:
     // ctor
-    HistoricalRiskService() = default;
+    HistoricalRiskService() : connector(new HistoricalRiskConnector<V>) {}
     HistoricalRiskService(HistoricalRiskConnector<V>* _connector) : connector(_connector) {}
 
     // Persist data to a store
@@ -75,6 +83,12 @@ public:
     {
         connector->Publish(data);
     }
+
+    // Persist a block of data to a store
+    void PersistDataBatch(vector<PV01<V> >& data)
+    {
+        connector->PublishBatch(data);
+    }
 };
 
 
@@ -89,7 +103,7 @@ private:
 
 public:
     // ctor
-    HistoricalStreamingService() = default;
+    HistoricalStreamingService() : connector(new HistoricalStreamingConnector<V>) {}
     HistoricalStreamingService(HistoricalStreamingConnector<V>* _connector) : connector(_connector) {}
 
     // Persist data to a store
@@ -97,6 +111,12 @@ public:
     {
         connector->Publish(data);
     }
+
+    // Persist a block of data to a store
+    void PersistDataBatch(vector<PriceStream<V> >& data)
+    {
+        connector->PublishBatch(data);
+    }
 };
 
 
@@ -111,7 +131,7 @@ private:
 
 public:
     // ctor
-    HistoricalExecutionService() = default;
+    HistoricalExecutionService() : connector(new HistoricalExecutionConnector<V>) {}
     HistoricalExecutionService(HistoricalExecutionConnector<V>* _connector) : connector(_connector) {}
 
     // Persist data to a store
@@ -119,6 +139,12 @@ public:
     {
         connector->Publish(data);
     }
+
+    // Persist a block of data to a store
+    void PersistDataBatch(vector<ExecutionOrder<V> >& data)
+    {
+        connector->PublishBatch(data);
+    }
 };
 
 
@@ -133,7 +159,7 @@ private:
 
 public:
     // ctor
-    HistoricalInquiryService() = default;
+    HistoricalInquiryService() : connector(new HistoricalInquiryConnector<V>) {}
     HistoricalInquiryService(HistoricalInquiryConnector<V>* _connector) : connector(_connector) {}
 
     // Persist data to a store
@@ -143,4 +169,38 @@ public:
     }
 };
 
+
+template <typename V>
+class HistoricalMarketDataConnector;
+
+template<typename V>
+class HistoricalMarketDataService : HistoricalDataService<OrderBook<V> >
+{
+private:
+    HistoricalMarketDataConnector<V>* connector;
+
+public:
+    // ctor
+    HistoricalMarketDataService() : connector(new HistoricalMarketDataConnector<V>) {}
+    HistoricalMarketDataService(HistoricalMarketDataConnector<V>* _connector) : connector(_connector) {}
+
+    // Persist data to a store
+    void PersistData(string persistKey, OrderBook<V>& data) override
+    {
+        connector->Publish(data);
+    }
+
+    // Persist a block of data to a store
+    void PersistDataBatch(vector<OrderBook<V> >& data)
+    {
+        connector->PublishBatch(data);
+    }
+
+    // Finish the store once no more data will come
+    void Close()
+    {
+        connector->Close();
+    }
+};
+
 #endif
@@ -6,6 +6,7 @@
 #include <map>
 #include <string>
 #include "SOA.hpp"
+#include "TickPrice.hpp"
 #include "TradeBookingService.hpp"
 
  // Various inqyury states
@@ -19,10 +20,10 @@ template<typename T>
 class Inquiry
 {
 public:
-    // ctor
+    // ctor, the product is referenced and must outlive the inquiry
     Inquiry() = default;
     Inquiry(string _inquiryId, const T& _product, Side _side, long _quantity, 
-        double _price, InquiryState _state);
+        TickPrice _price, InquiryState _state);
 
     // Get the inquiry ID
     const string& GetInquiryId() const;
@@ -37,7 +38,7 @@ public:
     long GetQuantity() const;
 
     // Get the price that we have responded back with
-    double GetPrice() const;
+    TickPrice GetPrice() const;
 
     // Get the current state on the inquiry
     InquiryState GetState() const;
@@ -46,14 +47,14 @@ public:
     void SetState(InquiryState _state);
 
     // Change the price
-    void SetPrice(double _price);
+    void SetPrice(TickPrice _price);
     
 private:
     string inquiryId;
-    T product;
+    const T* product = nullptr;
     Side side;
     long quantity;
-    double price;
+    TickPrice price;
     InquiryState state;
 
 };
@@ -78,7 +79,7 @@ public:
     void OnMessage(Inquiry<T>& data);
 
     // Send a quote back to the client
-    void SendQuote(const string& inquiryId, double price);
+    void SendQuote(const string& inquiryId, TickPrice price);
 
     // Reject an inquiry from the client
     void RejectInquiry(const string& inquiryId);
@@ -87,8 +88,8 @@ public:
 
 
 template<typename T>
-Inquiry<T>::Inquiry(string _inquiryId, const T& _product, Side _side, long _quantity, double _price, InquiryState _state) :
-    product(_product)
+Inquiry<T>::Inquiry(string _inquiryId, const T& _product, Side _side, long _quantity, TickPrice _price, InquiryState _state) :
+    product(&_product)
 {
     inquiryId = _inquiryId;
     side = _side;
@@ -106,7 +107,7 @@ const string& Inquiry<T>::GetInquiryId() const
 template<typename T>
 const T& Inquiry<T>::GetProduct() const
 {
-    return product;
+    return *product;
 }
 
 template<typename T>
@@ -122,7 +123,7 @@ long Inquiry<T>::GetQuantity() const
 }
 
 template<typename T>
-double Inquiry<T>::GetPrice() const
+TickPrice Inquiry<T>::GetPrice() const
 {
     return price;
 }
@@ -141,7 +142,7 @@ void Inquiry<T>::SetState(InquiryState _state)
 
 
 template <typename T>
-void Inquiry<T>::SetPrice(double _price)
+void Inquiry<T>::SetPrice(TickPrice _price)
 {
     price = _price;
 }
@@ -156,11 +157,12 @@ Inquiry<T>& InquiryService<T>::GetData(string key)
 template <typename T>
 void InquiryService<T>::OnMessage(Inquiry<T>& data)
 {
+    SOA_LATENCY_SCOPE("InquiryService::OnMessage");
     inquiries[data.GetInquiryId()] = data;
     if (data.GetState() == RECEIVED)
     {
         string inquiryId = data.GetInquiryId();
-        this->SendQuote(inquiryId, 100.0);
+        this->SendQuote(inquiryId, TickPrice::FromDouble(100.0));
         Service<string, Inquiry<T> >::Notify(data);
     }
     else if (data.GetState() == QUOTED)
@@ -171,7 +173,7 @@ void InquiryService<T>::OnMessage(Inquiry<T>& data)
 }
 
 template <typename T>
-void InquiryService<T>::SendQuote(const string& inquiryId, double price)
+void InquiryService<T>::SendQuote(const string& inquiryId, TickPrice price)
 {
     inquiries[inquiryId].SetPrice(price);
 }
@@ -3,6 +3,7 @@
 #ifndef LISTENERS_HPP
 #define LISTENERS_HPP
 
+#include <algorithm>
 #include "PositionService.hpp"
 #include "RiskService.hpp"
 #include "HistoricalDataService.hpp"
@@ -15,34 +16,42 @@
 using namespace std;
 
 // Listener to the position service
-template<typename T>
+template<typename T, typename S = PositionService<T> >
 class PositionServiceListener : public ServiceListener<Trade<T> >
 {
 private:
-    PositionService<T>* service;
+    S* service;
 public:
-    PositionServiceListener(PositionService<T>* _service) : service(_service) {}
+    PositionServiceListener(S* _service) : service(_service) {}
     void ProcessAdd(Trade<T>& data)
     {
         service->AddTrade(data);
     }
+    void ProcessAddBatch(vector<Trade<T> >& data)
+    {
+        service->AddTradeBatch(data);
+    }
     void ProcessRemove(Trade<T>& data) {}
     void ProcessUpdate(Trade<T>& data) {}
 };
 
 
 // Listener to the risk service
-template<typename T>
+template<typename T, typename S = RiskService<T> >
 class RiskServiceListener : public ServiceListener<Position<T> >
 {
 private:
-    RiskService<T>* service;
+    S* service;
 public:
-    RiskServiceListener(RiskService<T>* _service) : service(_service) {}
+    RiskServiceListener(S* _service) : service(_service) {}
     void ProcessAdd(Position<T>& data)
     {
         service->AddPosition(data);
     }
+    void ProcessAddBatch(vector<Position<T> >& data)
+    {
+        service->AddPositionBatch(data);
+    }
     void ProcessRemove(Position<T>& data) {}
     void ProcessUpdate(Position<T>& data) {}
 };
@@ -61,6 +70,10 @@ public:
         string id = data.GetProduct().GetProductId();
         service->PersistData(id, data);
     }
+    void ProcessAddBatch(vector<Position<T> >& data)
+    {
+        service->PersistDataBatch(data);
+    }
     void ProcessRemove(Position<T>& data) {}
     void ProcessUpdate(Position<T>& data) {}
 };
@@ -79,6 +92,10 @@ public:
         string id = data.GetProduct().GetProductId();
         service->PersistData(id, data);
     }
+    void ProcessAddBatch(vector<PV01<T> >& data)
+    {
+        service->PersistDataBatch(data);
+    }
     void ProcessRemove(PV01<T>& data) {}
     void ProcessUpdate(PV01<T>& data) {}
 };
@@ -96,6 +113,10 @@ public:
         string id = data.GetProduct().GetProductId();
         service->PersistData(id, data);
     }
+    void ProcessAddBatch(vector<PriceStream<T> >& data)
+    {
+        service->PersistDataBatch(data);
+    }
     void ProcessRemove(PriceStream<T>& data) {}
     void ProcessUpdate(PriceStream<T>& data) {}
 };
@@ -114,6 +135,10 @@ public:
         string id = data.GetProduct().GetProductId();
         service->PersistData(id, data);
     }
+    void ProcessAddBatch(vector<ExecutionOrder<T> >& data)
+    {
+        service->PersistDataBatch(data);
+    }
     virtual void ProcessRemove(ExecutionOrder<T>& data) {}
     virtual void ProcessUpdate(ExecutionOrder<T>& data) {}
 };
@@ -137,6 +162,28 @@ public:
 };
 
 
+// Listener to the historical market data service
+template<typename T>
+class HistoricalMarketDataListener :public ServiceListener<OrderBook<T> >
+{
+private:
+    HistoricalMarketDataService<T>* service;
+public:
+    HistoricalMarketDataListener(HistoricalMarketDataService<T>* _service) : service(_service) {}
+    void ProcessAdd(OrderBook<T>& data)
+    {
+        string id = data.GetProduct().GetProductId();
+        service->PersistData(id, data);
+    }
+    void ProcessAddBatch(vector<OrderBook<T> >& data)
+    {
+        service->PersistDataBatch(data);
+    }
+    virtual void ProcessRemove(OrderBook<T>& data) {}
+    virtual void ProcessUpdate(OrderBook<T>& data) {}
+};
+
+
 // Listener to the GUI service
 template<typename T>
 class GUIServiceListener : public ServiceListener<Price<T> >
@@ -155,33 +202,41 @@ public:
 
 
 // Listener to the streaming service
-template<typename T>
+template<typename T, typename S = StreamingService<T> >
 class StreamingServiceListener :public ServiceListener<PriceStream <T> >
 {
 private:
-    StreamingService<T>* service;
+    S* service;
 public:
-    StreamingServiceListener(StreamingService<T>* _service) : service(_service) {}
+    StreamingServiceListener(S* _service) : service(_service) {}
     void ProcessAdd(PriceStream <T>& data)
     {
         service->PublishPrice(data);
     }
+    void ProcessAddBatch(vector<PriceStream<T> >& data)
+    {
+        service->PublishPriceBatch(data);
+    }
     void ProcessRemove(PriceStream <T>& data) {}
     void ProcessUpdate(PriceStream <T>& data) {}
 };
 
 
 // Listener to the execution service
-template<typename T>
+template<typename T, typename S = ExecutionService<T> >
 class ExecutionServiceListener :public ServiceListener<ExecutionOrder<T> >
 {
 private:
-    ExecutionService<T>* service;
+    S* service;
 public:
-    ExecutionServiceListener(ExecutionService<T>* _service) : service(_service) {}
+    ExecutionServiceListener(S* _service) : service(_service) {}
     void ProcessAdd(ExecutionOrder<T>& data)
     {
-        service->ExecuteOrder(data, CME);
+        service->ExecuteOrder(data, data.GetVenue());
+    }
+    void ProcessAddBatch(vector<ExecutionOrder<T> >& data)
+    {
+        service->ExecuteOrderBatch(data);
     }
     void ProcessRemove(ExecutionOrder<T>& data) {}
     void ProcessUpdate(ExecutionOrder<T>& data) {}
@@ -189,54 +244,134 @@ public:
 
 
 // Listener to the algo streaming service
-template <typename T>
+template<typename T, typename S = AlgoStreamingService<T> >
 class AlgoStreamingServiceListener :public ServiceListener<Price<T> >
 {
 private:
-    AlgoStreamingService<T>* service;
+    S* service;
 public:
-    AlgoStreamingServiceListener(AlgoStreamingService<T>* _service) : service(_service) {}
+    AlgoStreamingServiceListener(S* _service) : service(_service) {}
     void ProcessAdd(Price<T>& data)
     {
         service->PublishPrice(data);
     }
+    void ProcessAddBatch(vector<Price<T> >& data)
+    {
+        service->PublishPriceBatch(data);
+    }
     void ProcessRemove(Price<T>& data) {}
     void ProcessUpdate(Price<T>& data) {}
 };
 
 
 // Listener to the algo execution service
-template <typename T>
+template<typename T, typename S = AlgoExecutionService<T> >
 class AlgoExecutionServiceListener :public ServiceListener<OrderBook <T> >
 {
 private:
-    AlgoExecutionService<T>* service;
+    S* service;
 public:
-    AlgoExecutionServiceListener(AlgoExecutionService<T>* _service) : service(_service) {}
+    AlgoExecutionServiceListener(S* _service) : service(_service) {}
     void ProcessAdd(OrderBook<T>& data)
     {
         service->ExecuteOrder(data);
     }
+    void ProcessAddBatch(vector<OrderBook<T> >& data)
+    {
+        service->ExecuteOrderBatch(data);
+    }
     void ProcessRemove(OrderBook<T>& data) {}
     void ProcessUpdate(OrderBook<T>& data) {}
 };
 
 
+// Listener to the levels deltas change, for the algo execution service.
+// The algo only reads the best bid and offer, so a delta is passed on only if the best level of
+// its side before or after it lies in the changed levels [first, end); any other delta leaves
+// the top of the book as it was. In a batch the books already reflect the whole batch, so each
+// book is passed on once, in the order of its last update that could move the top.
+template<typename T, typename S = AlgoExecutionService<T> >
+class AlgoExecutionUpdateListener :public ServiceListener<OrderBookUpdate<T> >
+{
+private:
+    S* service;
+    vector<OrderBook<T> > books;        // reused by ProcessAddBatch
+    vector<uint64_t> batch_stamps;      // batch a book was last taken in, by product and venue
+    uint64_t batch_count;
+
+    static bool MovesTop(const OrderBookUpdate<T>& update)
+    {
+        uint32_t first = update.GetFirstLevel();
+        uint32_t end = update.GetEndLevel();
+        return (update.GetPreviousBestLevel() >= first && update.GetPreviousBestLevel() < end) ||
+            (update.GetBestLevel() >= first && update.GetBestLevel() < end);
+    }
+
+public:
+    AlgoExecutionUpdateListener(S* _service) : service(_service), batch_count(0) {}
+    void ProcessAdd(OrderBookUpdate<T>& data)
+    {
+        if (MovesTop(data))
+            service->ExecuteOrder(data.GetBook());
+    }
+    void ProcessAddBatch(vector<OrderBookUpdate<T> >& data)
+    {
+        ++batch_count;
+        books.clear();
+        for (size_t i = data.size(); i-- > 0;)
+        {
+            if (!MovesTop(data[i]))
+                continue;
+            const OrderBook<T>& book = data[i].GetBook();
+            size_t slot = (size_t)book.GetProduct().GetProductIndex() * MARKET_COUNT + book.GetVenue();
+            if (slot >= batch_stamps.size())
+                batch_stamps.resize(slot + 1);
+            if (batch_stamps[slot] == batch_count)
+                continue;
+            batch_stamps[slot] = batch_count;
+            books.push_back(book);
+        }
+        if (books.empty())
+            return;
+        reverse(books.begin(), books.end());
+        service->ExecuteOrderBatch(books);
+    }
+    void ProcessRemove(OrderBookUpdate<T>& data) {}
+    void ProcessUpdate(OrderBookUpdate<T>& data) {}
+};
+
+
 // Listener to the trade booking service
-template<typename T>
+template<typename T, typename S = TradeBookingService<T> >
 class TradeBookingServiceListener :public ServiceListener<ExecutionOrder <T> >
 {
 private:
-    TradeBookingService<T>* service;
+    S* service;
     int counter;
 
 public:
-    TradeBookingServiceListener(TradeBookingService<T>* _service) : service(_service), counter(0) {}
+    TradeBookingServiceListener(S* _service) : service(_service), counter(0) {}
     void ProcessAdd(ExecutionOrder <T>& data)
     {
-        T product = data.GetProduct();
-        string tradeid = data.GetOrderId();
-        double price = data.GetPrice();
+        Trade<T> trade = MakeTrade(data);
+        service->OnMessage(trade);
+    }
+    void ProcessAddBatch(vector<ExecutionOrder<T> >& data)
+    {
+        vector<Trade<T> > trades;
+        trades.reserve(data.size());
+        for (auto& e : data)
+            trades.push_back(MakeTrade(e));
+        service->OnMessageBatch(trades);
+    }
+
+    void ProcessRemove(ExecutionOrder <T>& data) {}
+    void ProcessUpdate(ExecutionOrder <T>& data) {}
+
+private:
+    // Book an execution as a trade
+    Trade<T> MakeTrade(ExecutionOrder <T>& data)
+    {
         string book;
         if (counter % 3 == 0)
             book = "TRSY1";
@@ -253,12 +388,8 @@ public:
         else
             order_side = SELL;
 
-        Trade<T> trade(product, tradeid, price, book, quantity, order_side);
-        service->OnMessage(trade);
+        return Trade<T>(data.GetProduct(), data.GetOrderId(), data.GetPrice(), book, quantity, order_side);
     }
-
-    void ProcessRemove(ExecutionOrder <T>& data) {}
-    void ProcessUpdate(ExecutionOrder <T>& data) {}
 };
 
 
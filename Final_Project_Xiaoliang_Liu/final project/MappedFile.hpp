@@ -0,0 +1,172 @@
+
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <string>
+#include <string_view>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+/**
+ * Read-only memory mapping of a whole input file.
+ * The data is handed out as a string_view into the mapping, so parsers read fields in place
+ * without copying them. The kernel is told the file is read sequentially, and is asked to back
+ * the mapping with huge pages where it supports that for file mappings.
+ */
+class MappedFile
+{
+public:
+    // ctor, maps the file; check IsOpen() for success
+    MappedFile(const string& file_name);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Whether the file could be opened and mapped
+    bool IsOpen() const;
+
+    // Get the contents of the file
+    string_view GetData() const;
+
+    // Get the size of the file in bytes
+    size_t GetSize() const;
+
+private:
+    const char* data;
+    size_t size;
+    bool is_open;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+
+// Split a line at each delimiter into at most max_fields fields, returns the number of fields.
+// Like getline() on a stringstream, a trailing delimiter does not start an empty field.
+size_t SplitFields(string_view line, string_view* fields, size_t max_fields, char delimiter = ',');
+
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const string& file_name) :
+    data(nullptr), size(0), is_open(false), file(INVALID_HANDLE_VALUE), mapping(NULL)
+{
+    file = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size))
+        return;
+    size = (size_t)file_size.QuadPart;
+    is_open = true;
+    if (size == 0)
+        return;
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping != NULL)
+        data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == nullptr)
+    {
+        is_open = false;
+        size = 0;
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (data != nullptr)
+        UnmapViewOfFile(data);
+    if (mapping != NULL)
+        CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE)
+        CloseHandle(file);
+}
+
+#else
+
+MappedFile::MappedFile(const string& file_name) : data(nullptr), size(0), is_open(false)
+{
+    int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) == 0)
+    {
+        size = (size_t)st.st_size;
+        is_open = true;
+        if (size > 0)
+        {
+            void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED)
+            {
+                is_open = false;
+                size = 0;
+            }
+            else
+            {
+                data = (const char*)p;
+#ifdef MADV_HUGEPAGE
+                madvise(p, size, MADV_HUGEPAGE);
+#endif
+                madvise(p, size, MADV_SEQUENTIAL);
+                madvise(p, size, MADV_WILLNEED);
+            }
+        }
+    }
+    close(fd);      // the mapping keeps the file open
+}
+
+MappedFile::~MappedFile()
+{
+    if (data != nullptr)
+        munmap((void*)data, size);
+}
+
+#endif
+
+bool MappedFile::IsOpen() const
+{
+    return is_open;
+}
+
+string_view MappedFile::GetData() const
+{
+    return string_view(data, size);
+}
+
+size_t MappedFile::GetSize() const
+{
+    return size;
+}
+
+
+size_t SplitFields(string_view line, string_view* fields, size_t max_fields, char delimiter)
+{
+    size_t count = 0;
+    size_t start = 0;
+    while (start < line.size() && count < max_fields)
+    {
+        size_t end = line.find(delimiter, start);
+        if (end == string_view::npos)
+            end = line.size();
+        fields[count++] = line.substr(start, end - start);
+        start = end + 1;
+    }
+    return count;
+}
+
+#endif
@@ -2,25 +2,40 @@
 #ifndef MARKETDATA_SERVICE_HPP
 #define MARKETDATA_SERVICE_HPP
 
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <string>
 #include <vector>
 #include <map>
 #include <unordered_map>
 #include "SOA.hpp"
+#include "Products.hpp"
+#include "TickPrice.hpp"
+#include "SeqLock.hpp"
 
 using namespace std;
 enum PricingSide { BID, OFFER };
 
+// Venues the products trade on, books and deltas are tagged with the one they come from
+enum Market { BROKERTEC, ESPEED, CME };
+const size_t MARKET_COUNT = 3;
+
+// Get a venue from its name, false if there is no such venue
+bool ParseMarket(string_view name, Market& market);
+
 
 class Order
 {
 public:
     // ctor for an order
     Order() = default;
-    Order(double _price, long _quantity, PricingSide _side);
+    Order(TickPrice _price, long _quantity, PricingSide _side);
 
     // Get the price on the order
-    double GetPrice() const;
+    TickPrice GetPrice() const;
 
     // Get the quantity on the order
     long GetQuantity() const;
@@ -29,7 +44,7 @@ public:
     PricingSide GetSide() const;
 
 private:
-    double price;
+    TickPrice price;
     long quantity;
     PricingSide side;
 
@@ -58,71 +73,456 @@ private:
 };
 
 
+// Price levels per side of an order book, the Treasury books carry five
+const size_t ORDER_BOOK_DEPTH = 5;
+
+
 /**
- * Order book with a bid and offer stack.
+ * Order book with a bid and offer stack of at most N levels each.
  * Type T is the product type.
+ * The levels are stored inline as arrays of prices and quantities per side, so a book never
+ * allocates and copies with a memcpy; a 5-level book takes 184 bytes. GetBidStack() and
+ * GetOfferStack() build vectors of orders for callers that want them, hot paths read the
+ * levels directly. The book keeps track of its best levels as they change, the highest bid
+ * and the lowest offer wherever they sit in the stack. A book holds the levels of one venue.
  */
-template<typename T>
+template<typename T, size_t N = ORDER_BOOK_DEPTH>
 class OrderBook
 {
+    static_assert(N > 0 && N <= 0xFFFF, "OrderBook depth must fit in 16 bits");
+
 public:
-    // ctor for the order book
+    // ctor for the order book, the product is referenced and must outlive the book
     OrderBook() = default;
+    OrderBook(const T& _product, Market _venue = BROKERTEC);
+    // ctor from stacks of orders, levels beyond N are dropped
     OrderBook(const T& _product, const vector<Order>& _bidStack, const vector<Order>& _offerStack);
 
     // Get the product
     const T& GetProduct() const;
 
+    // Get the venue the levels are quoted on
+    Market GetVenue() const;
+
+    // Get the most levels a side can hold
+    static constexpr size_t GetMaxDepth() { return N; }
+
+    // Get the number of bid levels
+    size_t GetBidDepth() const;
+
+    // Get the number of offer levels
+    size_t GetOfferDepth() const;
+
+    // Get the price and quantity of a bid level
+    TickPrice GetBidPrice(size_t level) const;
+    long GetBidQuantity(size_t level) const;
+
+    // Get the price and quantity of an offer level
+    TickPrice GetOfferPrice(size_t level) const;
+    long GetOfferQuantity(size_t level) const;
+
+    // Get a level as an order
+    Order GetBid(size_t level) const;
+    Order GetOffer(size_t level) const;
+
+    // Get the level with the highest bid and the one with the lowest offer, the first of equals.
+    // Only meaningful while the side has levels.
+    size_t GetBestBidLevel() const;
+    size_t GetBestOfferLevel() const;
+
+    // Add a level below the existing ones, false if the side is full
+    bool AddBid(TickPrice price, long quantity);
+    bool AddOffer(TickPrice price, long quantity);
+
+    // Remove all levels
+    void Clear();
+
+    // Insert a level at a position, the levels below move down and a full side drops its last
+    bool InsertLevel(PricingSide side, size_t level, TickPrice price, long quantity);
+
+    // Replace the price and quantity of a level
+    bool UpdateLevel(PricingSide side, size_t level, TickPrice price, long quantity);
+
+    // Delete a level, the levels below move up
+    bool DeleteLevel(PricingSide side, size_t level);
+
     // Get the bid stack
-    const vector<Order>& GetBidStack() const;
+    vector<Order> GetBidStack() const;
 
     // Get the offer stack
-    const vector<Order>& GetOfferStack() const;
+    vector<Order> GetOfferStack() const;
 
 private:
-    T product;
-    vector<Order> bidStack;
-    vector<Order> offerStack;
+    const T* product = nullptr;
+    Market venue = BROKERTEC;
+    uint16_t bidDepth = 0;
+    uint16_t offerDepth = 0;
+    uint16_t bestBid = 0;
+    uint16_t bestOffer = 0;
+    TickPrice bidPrices[N];
+    TickPrice offerPrices[N];
+    long bidQuantities[N] = {};
+    long offerQuantities[N] = {};
+
+    // Find the best level of a side again after levels moved
+    void FindBest(PricingSide side);
 };
 
+// Get the best bid and offer of a book, a side without levels gives a zero order
+template<typename T, size_t N>
+BidOffer BestBidOffer(const OrderBook<T, N>& book);
+
+
+// Get the number of bits that hold every number below n
+constexpr int BitsToCount(size_t n)
+{
+    return n <= 1 ? 0 : 1 + BitsToCount((n + 1) / 2);
+}
+
 
 /**
- * Market Data Service which distributes market data
- * Keyed on product identifier.
+ * Aggregated depth of an order book: each side's distinct prices sorted best first, the
+ * quantity at each price and the cumulative quantity from the top of the side down to it.
+ * MarketDataService keeps one per product and venue and updates it whenever the book changes,
+ * so the sweep queries below are binary searches over at most N levels with nothing to rebuild.
+ * Stored inline like OrderBook, N is the most levels per side.
+ */
+template<size_t N = ORDER_BOOK_DEPTH>
+class AggregatedDepth
+{
+public:
+    // ctor for empty depth
+    AggregatedDepth() = default;
+
+    // Aggregate both sides of a book
+    template<typename T>
+    void Update(const OrderBook<T, N>& book);
+
+    // Aggregate one side of a book
+    template<typename T>
+    void Update(const OrderBook<T, N>& book, PricingSide side);
+
+    // Get the number of distinct prices of a side
+    size_t GetLevelCount(PricingSide side) const;
+
+    // Get the price of a level, level 0 is the best
+    TickPrice GetPrice(PricingSide side, size_t level) const;
+
+    // Get the quantity at the price of a level
+    long GetQuantity(PricingSide side, size_t level) const;
+
+    // Get the quantity from the best level down to and including a level
+    long GetCumulativeQuantity(PricingSide side, size_t level) const;
+
+    // Get the quantity available at prices up to a limit: bids at or above it, offers at or below it
+    long GetSizeUpTo(PricingSide side, TickPrice limit) const;
+
+    // Get the worst price reached when filling a quantity against a side, false if the side is too thin
+    bool GetPriceToFill(PricingSide side, long quantity, TickPrice& price) const;
+
+private:
+    struct Side
+    {
+        uint32_t count = 0;
+        TickPrice prices[N];
+        long quantities[N] = {};
+        long cumulative[N] = {};
+    };
+
+    static const int index_bits = BitsToCount(N);     // bits of a level position
+
+    Side bids;
+    Side offers;
+
+    const Side& GetSide(PricingSide side) const;
+
+    // Sort and merge the levels of a side into out
+    template<bool Descending>
+    static void Aggregate(const TickPrice* prices, const long* quantities, size_t depth, Side& out);
+};
+
+
+/**
+ * Order book of a product consolidated across venues: each side's distinct prices over all
+ * venues sorted best first, with the quantity every venue shows at the price and their total.
+ * MarketDataService keeps one per product. A book or delta from a venue only aggregates that
+ * venue's depth; the best bid and offer are taken from the venues' top levels right away, and
+ * the levels of the venues that changed are merged into the consolidated sides by Consolidate(),
+ * in place of their old ones, so a burst of books costs one merge when the levels are read.
+ * Stored inline, N is the most levels per side a venue contributes.
+ */
+template<size_t N = ORDER_BOOK_DEPTH>
+class ConsolidatedBook
+{
+public:
+    // ctor for an empty book
+    ConsolidatedBook() = default;
+
+    // Get the most levels a side can hold
+    static constexpr size_t GetMaxLevels() { return N * MARKET_COUNT; }
+
+    // Take the levels of a venue's book, on both sides or one
+    template<typename T>
+    void Update(const OrderBook<T, N>& book);
+    template<typename T>
+    void Update(const OrderBook<T, N>& book, PricingSide side);
+
+    // Merge the levels of the venues updated since the last call into the consolidated sides
+    void Consolidate();
+
+    // Get the aggregated depth of a venue
+    const AggregatedDepth<N>& GetVenueDepth(Market venue) const;
+
+    // Get the best bid and offer over all venues, always current. The quantity is the total of
+    // the venues at the price, a side without levels gives a zero order.
+    BidOffer GetBestBidOffer() const;
+
+    // Get the number of distinct prices of a side, as of the last Consolidate() like the getters below
+    size_t GetLevelCount(PricingSide side) const;
+
+    // Get the price of a level, level 0 is the best
+    TickPrice GetPrice(PricingSide side, size_t level) const;
+
+    // Get the quantity at the price of a level over all venues
+    long GetQuantity(PricingSide side, size_t level) const;
+
+    // Get the quantity a venue shows at the price of a level
+    long GetVenueQuantity(PricingSide side, size_t level, Market venue) const;
+
+    // Get the venue showing the most quantity at the price of a level, the first of equals
+    Market GetLargestVenue(PricingSide side, size_t level) const;
+
+private:
+    struct Side
+    {
+        uint32_t count = 0;
+        uint32_t pending = 0;       // bit per venue updated since the side was merged
+        TickPrice prices[N * MARKET_COUNT];
+        long quantities[N * MARKET_COUNT] = {};
+        long venueQuantities[N * MARKET_COUNT][MARKET_COUNT] = {};
+    };
+
+    AggregatedDepth<N> venues[MARKET_COUNT];
+    Side bids;
+    Side offers;
+
+    const Side& GetSide(PricingSide side) const;
+
+    // Get the best order of a side over the venues' top levels
+    Order BestOrder(PricingSide side) const;
+
+    // Merge the sorted levels of a venue into a side, in place of the venue's old ones
+    template<bool Descending>
+    static void Merge(Market venue, const AggregatedDepth<N>& depth, PricingSide side, Side& out);
+};
+
+
+// Change a delta makes to a level of a book
+enum BookAction { LEVEL_INSERT, LEVEL_UPDATE, LEVEL_DELETE };
+
+
+/**
+ * Incremental update of one price level of an order book, as venue feeds send them.
+ * Levels are numbered from 0, the top of the side. An insert pushes the levels from its
+ * position down, a delete pulls the ones below it up. Sequence numbers run per product
+ * and venue.
+ * Type T is the product type.
+ */
+template<typename T>
+class OrderBookDelta
+{
+public:
+    // ctor for a delta, the product is referenced and must outlive the delta
+    OrderBookDelta() = default;
+    OrderBookDelta(const T& _product, Market _venue, uint64_t _sequence, PricingSide _side, BookAction _action, uint32_t _level,
+        TickPrice _price = TickPrice(), long _quantity = 0);
+
+    // Get the product
+    const T& GetProduct() const;
+
+    // Get the venue of the book
+    Market GetVenue() const;
+
+    // Get the sequence number
+    uint64_t GetSequence() const;
+
+    // Get the side of the level
+    PricingSide GetSide() const;
+
+    // Get the change to the level
+    BookAction GetAction() const;
+
+    // Get the level
+    uint32_t GetLevel() const;
+
+    // Get the new price of the level, unused by a delete
+    TickPrice GetPrice() const;
+
+    // Get the new quantity of the level, unused by a delete
+    long GetQuantity() const;
+
+private:
+    const T* product = nullptr;
+    Market venue = BROKERTEC;
+    uint64_t sequence = 0;
+    PricingSide side = BID;
+    BookAction action = LEVEL_INSERT;
+    uint32_t level = 0;
+    TickPrice price;
+    long quantity = 0;
+};
+
+
+/**
+ * Notification that a delta was applied to an order book kept by the MarketDataService.
+ * Tells which levels of which side changed and refers to the book itself, so listeners
+ * read the levels they care about in place. The book is the service's and reflects every
+ * delta applied so far, in a batch the whole batch; copy it with GetSnapshot() to keep it.
  * Type T is the product type.
  */
 template<typename T>
-class MarketDataService : public Service<string, OrderBook <T> >
+class OrderBookUpdate
+{
+public:
+    // ctor for an update of levels [first_level, end_level) of a side, with the side's best
+    // level before and after the delta
+    OrderBookUpdate() = default;
+    OrderBookUpdate(const OrderBook<T>& _book, const OrderBookDelta<T>& _delta, uint32_t _firstLevel, uint32_t _endLevel,
+        uint32_t _previousBestLevel, uint32_t _bestLevel);
+
+    // Get the book after the delta
+    const OrderBook<T>& GetBook() const;
+
+    // Get the delta
+    const OrderBookDelta<T>& GetDelta() const;
+
+    // Get the side that changed
+    PricingSide GetSide() const;
+
+    // Get the first changed level
+    uint32_t GetFirstLevel() const;
+
+    // Get one past the last changed level, levels from the side's depth on were removed
+    uint32_t GetEndLevel() const;
+
+    // Get the best level of the side before the delta, 0 if the side was empty
+    uint32_t GetPreviousBestLevel() const;
+
+    // Get the best level of the side after the delta, 0 if the side is empty
+    uint32_t GetBestLevel() const;
+
+private:
+    const OrderBook<T>* book = nullptr;
+    OrderBookDelta<T> delta;
+    uint32_t firstLevel = 0;
+    uint32_t endLevel = 0;
+    uint32_t previousBestLevel = 0;
+    uint32_t bestLevel = 0;
+};
+
+
+/**
+ * Market Data Service which distributes market data
+ * Keyed on product identifier, stored by product index.
+ * Books arrive tagged with their venue; the service keeps the latest book of each venue and
+ * a ConsolidatedBook per product across all of them, with the best bid/offer on top of it.
+ * Type T is the product type, Chain the compile-time listener chain.
+ */
+template<typename T, typename Chain = ListenerChain<OrderBook<T> > >
+class MarketDataService : public Service<string, OrderBook <T>, Chain>
 {
 private:
-    map<string, OrderBook<T>> orderbooks;
+    ProductTable<OrderBook<T> > orderbooks[MARKET_COUNT];      // latest book of each venue
+    ProductTable<Market> last_venues;       // venue of the latest book per product
+    ProductTable<uint64_t> sequences[MARKET_COUNT];     // last delta sequence applied per product and venue
+    vector<ServiceListener<OrderBookUpdate<T> >*> update_listeners;
+    vector<OrderBookUpdate<T> > updates;    // reused by OnDeltaBatch
+    uint64_t sequence_gaps = 0;
+    SeqLockTable<BidOffer> best_bid_offers;  // top of each consolidated book, read lock-free by other threads
+    ProductTable<ConsolidatedBook<> > consolidated;     // books of all venues, with each venue's aggregated depth
+    OrderBook<T> empty_book;                // returned for a product id never seen, without a product
+    const ConsolidatedBook<> empty_consolidated;        // returned for a product id never seen
+
+    // Apply a delta to its book, false if it is stale or its level is out of range
+    bool ApplyDelta(OrderBookDelta<T>& delta, OrderBookUpdate<T>& update);
+
+    // Hand a book to the consolidated book and publish the best bid and offer over the venues
+    void UpdateViews(const OrderBook<T>& book);
 
 public:
     // ctor
     MarketDataService() = default;
 
-    // Get data on our service given a key
+    // Get the latest book of a product, from whichever venue sent it. An unknown product id
+    // gets an empty book without a product, and is not added to the ProductIndex.
     OrderBook<T>& GetData(string key);
 
+    // Get the latest book of a product given a product index
+    OrderBook<T>& GetData(int productIndex);
+
+    // Get the latest book of a product from a venue
+    OrderBook<T>& GetData(int productIndex, Market venue);
+
     // The callback that a Connector should invoke for any new or updated data
     void OnMessage(OrderBook<T>& data);
 
-    // Get the best bid/offer order
-    const BidOffer& GetBestBidOffer(string productId);
+    // The callback that a Connector should invoke for a block of new or updated data
+    void OnMessageBatch(vector<OrderBook<T> >& data);
+
+    // The callback that a Connector should invoke for an incremental update of a book.
+    // The book is changed in place and update listeners are told which levels changed; the
+    // listeners of whole books are not called. A delta whose sequence number is not above
+    // the last one applied for its product is dropped.
+    void OnDelta(OrderBookDelta<T>& delta);
+
+    // The callback that a Connector should invoke for a block of incremental updates, in order
+    void OnDeltaBatch(vector<OrderBookDelta<T> >& deltas);
+
+    // Add a listener for the levels changed by deltas
+    void AddUpdateListener(ServiceListener<OrderBookUpdate<T> >* listener);
+
+    // Get a copy of the current book of a product on a venue
+    OrderBook<T> GetSnapshot(string productId, Market venue);
+
+    // Get the sequence number of the last delta applied to a product's book on a venue
+    uint64_t GetSequence(string productId, Market venue);
 
-    // Aggregate the order book
-    const OrderBook<T>& AggregateDepth(string productId);
+    // Get the number of deltas that skipped sequence numbers
+    uint64_t GetSequenceGapCount() const;
+
+    // Get the best bid/offer order over all venues, kept up to date by every snapshot and delta.
+    // The quantity is the total of every venue at the price; a side without levels has a zero
+    // order. Any thread may call these while the connector thread updates the books; by
+    // product index they do not lock.
+    BidOffer GetBestBidOffer(string productId) const;
+    BidOffer GetBestBidOffer(int productIndex) const;
+
+    // Get the aggregated depth of a product's book on a venue, kept up to date by every
+    // snapshot and delta. Like GetData(), the reference is only valid on the connector
+    // thread and until a book of a new product arrives.
+    const AggregatedDepth<>& GetAggregatedDepth(string productId, Market venue);
+    const AggregatedDepth<>& GetAggregatedDepth(int productIndex, Market venue);
+
+    // Get the book of a product consolidated across venues, with the levels of every book so
+    // far merged in; valid like GetAggregatedDepth(). By product id, an unknown product gets an
+    // empty book here and above.
+    const ConsolidatedBook<>& GetConsolidatedBook(string productId);
+    const ConsolidatedBook<>& GetConsolidatedBook(int productIndex);
+
+    // Aggregate the order book across venues: one level per distinct price, sorted best first,
+    // as many as a book holds. A product without a book yet gets an empty book without a product.
+    OrderBook<T> AggregateDepth(string productId);
    
 };
 
-Order::Order(double _price, long _quantity, PricingSide _side)
+Order::Order(TickPrice _price, long _quantity, PricingSide _side)
 {
     price = _price;
     quantity = _quantity;
     side = _side;
 }
 
-double Order::GetPrice() const
+TickPrice Order::GetPrice() const
 {
     return price;
 }
@@ -138,6 +538,21 @@ PricingSide Order::GetSide() const
 }
 
 
+bool ParseMarket(string_view name, Market& market)
+{
+    static const char* const names[MARKET_COUNT] = { "BROKERTEC", "ESPEED", "CME" };
+    for (size_t i = 0; i < MARKET_COUNT; ++i)
+    {
+        if (name == names[i])
+        {
+            market = (Market)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+
 BidOffer::BidOffer(const Order& _bidOrder, const Order& _offerOrder) :
     bidOrder(_bidOrder), offerOrder(_offerOrder)
 {
@@ -154,91 +569,856 @@ const Order& BidOffer::GetOfferOrder() const
 }
 
 
+template<typename T, size_t N>
+OrderBook<T, N>::OrderBook(const T& _product, Market _venue) : product(&_product), venue(_venue)
+{
+}
+
+template<typename T, size_t N>
+OrderBook<T, N>::OrderBook(const T& _product, const vector<Order>& _bidStack, const vector<Order>& _offerStack) :
+    product(&_product)
+{
+    for (auto& e : _bidStack)
+        AddBid(e.GetPrice(), e.GetQuantity());
+    for (auto& e : _offerStack)
+        AddOffer(e.GetPrice(), e.GetQuantity());
+}
+
+template<typename T, size_t N>
+const T& OrderBook<T, N>::GetProduct() const
+{
+    return *product;
+}
+
+template<typename T, size_t N>
+Market OrderBook<T, N>::GetVenue() const
+{
+    return venue;
+}
+
+template<typename T, size_t N>
+size_t OrderBook<T, N>::GetBidDepth() const
+{
+    return bidDepth;
+}
+
+template<typename T, size_t N>
+size_t OrderBook<T, N>::GetOfferDepth() const
+{
+    return offerDepth;
+}
+
+template<typename T, size_t N>
+TickPrice OrderBook<T, N>::GetBidPrice(size_t level) const
+{
+    return bidPrices[level];
+}
+
+template<typename T, size_t N>
+long OrderBook<T, N>::GetBidQuantity(size_t level) const
+{
+    return bidQuantities[level];
+}
+
+template<typename T, size_t N>
+TickPrice OrderBook<T, N>::GetOfferPrice(size_t level) const
+{
+    return offerPrices[level];
+}
+
+template<typename T, size_t N>
+long OrderBook<T, N>::GetOfferQuantity(size_t level) const
+{
+    return offerQuantities[level];
+}
+
+template<typename T, size_t N>
+Order OrderBook<T, N>::GetBid(size_t level) const
+{
+    return Order(bidPrices[level], bidQuantities[level], BID);
+}
+
+template<typename T, size_t N>
+Order OrderBook<T, N>::GetOffer(size_t level) const
+{
+    return Order(offerPrices[level], offerQuantities[level], OFFER);
+}
+
+template<typename T, size_t N>
+size_t OrderBook<T, N>::GetBestBidLevel() const
+{
+    return bestBid;
+}
+
+template<typename T, size_t N>
+size_t OrderBook<T, N>::GetBestOfferLevel() const
+{
+    return bestOffer;
+}
+
+template<typename T, size_t N>
+bool OrderBook<T, N>::AddBid(TickPrice price, long quantity)
+{
+    if (bidDepth == N)
+        return false;
+    bidPrices[bidDepth] = price;
+    bidQuantities[bidDepth] = quantity;
+    if (bidDepth == 0 || price > bidPrices[bestBid])
+        bestBid = bidDepth;
+    ++bidDepth;
+    return true;
+}
+
+template<typename T, size_t N>
+bool OrderBook<T, N>::AddOffer(TickPrice price, long quantity)
+{
+    if (offerDepth == N)
+        return false;
+    offerPrices[offerDepth] = price;
+    offerQuantities[offerDepth] = quantity;
+    if (offerDepth == 0 || price < offerPrices[bestOffer])
+        bestOffer = offerDepth;
+    ++offerDepth;
+    return true;
+}
+
+template<typename T, size_t N>
+void OrderBook<T, N>::Clear()
+{
+    bidDepth = 0;
+    offerDepth = 0;
+    bestBid = 0;
+    bestOffer = 0;
+}
+
+template<typename T, size_t N>
+bool OrderBook<T, N>::InsertLevel(PricingSide side, size_t level, TickPrice price, long quantity)
+{
+    uint16_t& depth = side == BID ? bidDepth : offerDepth;
+    TickPrice* prices = side == BID ? bidPrices : offerPrices;
+    long* quantities = side == BID ? bidQuantities : offerQuantities;
+    if (level > depth || level >= N)
+        return false;
+    size_t moved = min((size_t)depth, N - 1) - level;
+    memmove(prices + level + 1, prices + level, moved * sizeof(TickPrice));
+    memmove(quantities + level + 1, quantities + level, moved * sizeof(long));
+    prices[level] = price;
+    quantities[level] = quantity;
+    if (depth < N)
+        ++depth;
+    FindBest(side);
+    return true;
+}
+
+template<typename T, size_t N>
+bool OrderBook<T, N>::UpdateLevel(PricingSide side, size_t level, TickPrice price, long quantity)
+{
+    if (level >= (side == BID ? bidDepth : offerDepth))
+        return false;
+    (side == BID ? bidPrices : offerPrices)[level] = price;
+    (side == BID ? bidQuantities : offerQuantities)[level] = quantity;
+    FindBest(side);
+    return true;
+}
+
+template<typename T, size_t N>
+bool OrderBook<T, N>::DeleteLevel(PricingSide side, size_t level)
+{
+    uint16_t& depth = side == BID ? bidDepth : offerDepth;
+    TickPrice* prices = side == BID ? bidPrices : offerPrices;
+    long* quantities = side == BID ? bidQuantities : offerQuantities;
+    if (level >= depth)
+        return false;
+    size_t moved = depth - level - 1;
+    memmove(prices + level, prices + level + 1, moved * sizeof(TickPrice));
+    memmove(quantities + level, quantities + level + 1, moved * sizeof(long));
+    --depth;
+    FindBest(side);
+    return true;
+}
+
+template<typename T, size_t N>
+void OrderBook<T, N>::FindBest(PricingSide side)
+{
+    if (side == BID)
+    {
+        bestBid = 0;
+        for (uint16_t i = 1; i < bidDepth; ++i)
+        {
+            if (bidPrices[i] > bidPrices[bestBid])
+                bestBid = i;
+        }
+    }
+    else
+    {
+        bestOffer = 0;
+        for (uint16_t i = 1; i < offerDepth; ++i)
+        {
+            if (offerPrices[i] < offerPrices[bestOffer])
+                bestOffer = i;
+        }
+    }
+}
+
+template<typename T, size_t N>
+vector<Order> OrderBook<T, N>::GetBidStack() const
+{
+    vector<Order> stack;
+    stack.reserve(bidDepth);
+    for (size_t i = 0; i < bidDepth; ++i)
+        stack.push_back(GetBid(i));
+    return stack;
+}
+
+template<typename T, size_t N>
+vector<Order> OrderBook<T, N>::GetOfferStack() const
+{
+    vector<Order> stack;
+    stack.reserve(offerDepth);
+    for (size_t i = 0; i < offerDepth; ++i)
+        stack.push_back(GetOffer(i));
+    return stack;
+}
+
+
+template<typename T, size_t N>
+BidOffer BestBidOffer(const OrderBook<T, N>& book)
+{
+    Order best_bid = book.GetBidDepth() == 0 ? Order(TickPrice(), 0, BID) : book.GetBid(book.GetBestBidLevel());
+    Order best_offer = book.GetOfferDepth() == 0 ? Order(TickPrice(), 0, OFFER) : book.GetOffer(book.GetBestOfferLevel());
+    return BidOffer(best_bid, best_offer);
+}
+
+
+template<size_t N>
 template<typename T>
-OrderBook<T>::OrderBook(const T& _product, const vector<Order>& _bidStack, const vector<Order>& _offerStack) :
-    product(_product), bidStack(_bidStack), offerStack(_offerStack)
+void AggregatedDepth<N>::Update(const OrderBook<T, N>& book)
 {
+    Update(book, BID);
+    Update(book, OFFER);
 }
 
+template<size_t N>
 template<typename T>
-const T& OrderBook<T>::GetProduct() const
+void AggregatedDepth<N>::Update(const OrderBook<T, N>& book, PricingSide side)
+{
+    TickPrice prices[N];
+    long quantities[N];
+    size_t depth = side == BID ? book.GetBidDepth() : book.GetOfferDepth();
+    for (size_t i = 0; i < depth; ++i)
+    {
+        prices[i] = side == BID ? book.GetBidPrice(i) : book.GetOfferPrice(i);
+        quantities[i] = side == BID ? book.GetBidQuantity(i) : book.GetOfferQuantity(i);
+    }
+    if (side == BID)
+        Aggregate<true>(prices, quantities, depth, bids);
+    else
+        Aggregate<false>(prices, quantities, depth, offers);
+}
+
+template<size_t N>
+template<bool Descending>
+void AggregatedDepth<N>::Aggregate(const TickPrice* prices, const long* quantities, size_t depth, Side& out)
+{
+    // sort keys holding the price, negated for bids, above the level's position with a
+    // compare-exchange network: a fixed sequence of min/max steps, so random prices cost
+    // no branch misses the way an insertion sort's comparisons do
+    long long keys[N];
+    for (size_t i = 0; i < N; ++i)
+    {
+        long long ticks = i < depth ? prices[i].GetTicks() : 0;
+        keys[i] = i < depth ? (Descending ? -ticks : ticks) * (1LL << index_bits) + (long long)i : LLONG_MAX;
+    }
+    for (size_t round = 0; round < N; ++round)
+    {
+        for (size_t i = round % 2; i + 1 < N; i += 2)
+        {
+            long long a = keys[i];
+            long long b = keys[i + 1];
+            keys[i] = a < b ? a : b;
+            keys[i + 1] = a < b ? b : a;
+        }
+    }
+
+    // equal prices are next to each other now, add them up
+    out.count = 0;
+    long total = 0;
+    for (size_t i = 0; i < depth; ++i)
+    {
+        size_t level = (size_t)(keys[i] & ((1LL << index_bits) - 1));
+        total += quantities[level];
+        if (out.count > 0 && out.prices[out.count - 1] == prices[level])
+        {
+            out.quantities[out.count - 1] += quantities[level];
+        }
+        else
+        {
+            out.prices[out.count] = prices[level];
+            out.quantities[out.count] = quantities[level];
+            ++out.count;
+        }
+        out.cumulative[out.count - 1] = total;
+    }
+}
+
+template<size_t N>
+size_t AggregatedDepth<N>::GetLevelCount(PricingSide side) const
+{
+    return GetSide(side).count;
+}
+
+template<size_t N>
+TickPrice AggregatedDepth<N>::GetPrice(PricingSide side, size_t level) const
+{
+    return GetSide(side).prices[level];
+}
+
+template<size_t N>
+long AggregatedDepth<N>::GetQuantity(PricingSide side, size_t level) const
 {
-    return product;
+    return GetSide(side).quantities[level];
 }
 
+template<size_t N>
+long AggregatedDepth<N>::GetCumulativeQuantity(PricingSide side, size_t level) const
+{
+    return GetSide(side).cumulative[level];
+}
+
+template<size_t N>
+long AggregatedDepth<N>::GetSizeUpTo(PricingSide side, TickPrice limit) const
+{
+    const Side& e = GetSide(side);
+    // levels before the first price beyond the limit are within it
+    const TickPrice* end = side == BID ?
+        upper_bound(e.prices, e.prices + e.count, limit, greater<TickPrice>()) :
+        upper_bound(e.prices, e.prices + e.count, limit);
+    size_t levels = end - e.prices;
+    return levels == 0 ? 0 : e.cumulative[levels - 1];
+}
+
+template<size_t N>
+bool AggregatedDepth<N>::GetPriceToFill(PricingSide side, long quantity, TickPrice& price) const
+{
+    const Side& e = GetSide(side);
+    const long* level = lower_bound(e.cumulative, e.cumulative + e.count, quantity);
+    if (level == e.cumulative + e.count)
+        return false;
+    price = e.prices[level - e.cumulative];
+    return true;
+}
+
+template<size_t N>
+const typename AggregatedDepth<N>::Side& AggregatedDepth<N>::GetSide(PricingSide side) const
+{
+    return side == BID ? bids : offers;
+}
+
+
+template<size_t N>
 template<typename T>
-const vector<Order>& OrderBook<T>::GetBidStack() const
+void ConsolidatedBook<N>::Update(const OrderBook<T, N>& book)
 {
-    return bidStack;
+    venues[book.GetVenue()].Update(book);
+    bids.pending |= 1u << book.GetVenue();
+    offers.pending |= 1u << book.GetVenue();
 }
 
+template<size_t N>
 template<typename T>
-const vector<Order>& OrderBook<T>::GetOfferStack() const
+void ConsolidatedBook<N>::Update(const OrderBook<T, N>& book, PricingSide side)
 {
-    return offerStack;
+    venues[book.GetVenue()].Update(book, side);
+    (side == BID ? bids : offers).pending |= 1u << book.GetVenue();
 }
 
+template<size_t N>
+void ConsolidatedBook<N>::Consolidate()
+{
+    for (size_t i = 0; i < MARKET_COUNT; ++i)
+    {
+        if (bids.pending & (1u << i))
+            Merge<true>((Market)i, venues[i], BID, bids);
+        if (offers.pending & (1u << i))
+            Merge<false>((Market)i, venues[i], OFFER, offers);
+    }
+    bids.pending = 0;
+    offers.pending = 0;
+}
 
-template <typename T>
-OrderBook<T>& MarketDataService<T>::GetData(string key)
+template<size_t N>
+template<bool Descending>
+void ConsolidatedBook<N>::Merge(Market venue, const AggregatedDepth<N>& depth, PricingSide side, Side& out)
 {
-    return orderbooks[key];
+    // both lists are sorted best first: walk them together, taking the venue's quantity out
+    // of the old levels and putting its new one in; a level nobody quotes any more is dropped
+    const size_t max_levels = N * MARKET_COUNT;
+    TickPrice prices[max_levels];
+    long quantities[max_levels];
+    long venue_quantities[max_levels][MARKET_COUNT];
+    size_t count = 0;
+    size_t i = 0;
+    size_t j = 0;
+    size_t venue_count = depth.GetLevelCount(side);
+    while (i < out.count || j < venue_count)
+    {
+        bool from_old = i < out.count;
+        bool from_venue = j < venue_count;
+        if (from_old && from_venue && out.prices[i] != depth.GetPrice(side, j))
+        {
+            from_old = Descending ? out.prices[i] > depth.GetPrice(side, j) : out.prices[i] < depth.GetPrice(side, j);
+            from_venue = !from_old;
+        }
+
+        TickPrice price;
+        long row[MARKET_COUNT] = {};
+        long quantity = 0;
+        if (from_old)
+        {
+            price = out.prices[i];
+            memcpy(row, out.venueQuantities[i], sizeof(row));
+            quantity = out.quantities[i] - row[venue];
+            row[venue] = 0;
+            ++i;
+        }
+        if (from_venue)
+        {
+            price = depth.GetPrice(side, j);
+            row[venue] = depth.GetQuantity(side, j);
+            quantity += row[venue];
+            ++j;
+        }
+        if (quantity == 0)
+            continue;
+        prices[count] = price;
+        quantities[count] = quantity;
+        memcpy(venue_quantities[count], row, sizeof(row));
+        ++count;
+    }
+
+    out.count = (uint32_t)count;
+    memcpy(out.prices, prices, count * sizeof(TickPrice));
+    memcpy(out.quantities, quantities, count * sizeof(long));
+    memcpy(out.venueQuantities, venue_quantities, count * sizeof(venue_quantities[0]));
 }
 
-template <typename T>
-void MarketDataService<T>::OnMessage(OrderBook<T>& data)
+template<size_t N>
+const AggregatedDepth<N>& ConsolidatedBook<N>::GetVenueDepth(Market venue) const
 {
-    orderbooks[data.GetProduct().GetProductId()] = data;
-    Service<string, OrderBook<T> >::Notify(data);
+    return venues[venue];
 }
 
-template <typename T>
-const BidOffer& MarketDataService<T>::GetBestBidOffer(string productId)
+template<size_t N>
+BidOffer ConsolidatedBook<N>::GetBestBidOffer() const
 {
-    OrderBook<T> orderbook = orderbooks[productId];
-    vector<Order> bid_stack = orderbook.GetBidStack();
-    vector<Order> offer_stack = orderbook.GetOfferStack();
-    Order best_bid = bid_stack[0];
-    Order best_offer = offer_stack[0];
+    return BidOffer(BestOrder(BID), BestOrder(OFFER));
+}
 
-    for (auto& e : bid_stack)
+template<size_t N>
+Order ConsolidatedBook<N>::BestOrder(PricingSide side) const
+{
+    TickPrice best;
+    long quantity = 0;
+    bool found = false;
+    for (auto& e : venues)
     {
-        if (e.GetPrice() > best_bid.GetPrice())
-            best_bid = e;
+        if (e.GetLevelCount(side) == 0)
+            continue;
+        TickPrice price = e.GetPrice(side, 0);
+        if (!found || (side == BID ? price > best : price < best))
+        {
+            best = price;
+            quantity = e.GetQuantity(side, 0);
+            found = true;
+        }
+        else if (price == best)
+        {
+            quantity += e.GetQuantity(side, 0);
+        }
     }
-    for (auto& e : offer_stack)
+    return Order(best, quantity, side);
+}
+
+template<size_t N>
+size_t ConsolidatedBook<N>::GetLevelCount(PricingSide side) const
+{
+    return GetSide(side).count;
+}
+
+template<size_t N>
+TickPrice ConsolidatedBook<N>::GetPrice(PricingSide side, size_t level) const
+{
+    return GetSide(side).prices[level];
+}
+
+template<size_t N>
+long ConsolidatedBook<N>::GetQuantity(PricingSide side, size_t level) const
+{
+    return GetSide(side).quantities[level];
+}
+
+template<size_t N>
+long ConsolidatedBook<N>::GetVenueQuantity(PricingSide side, size_t level, Market venue) const
+{
+    return GetSide(side).venueQuantities[level][venue];
+}
+
+template<size_t N>
+Market ConsolidatedBook<N>::GetLargestVenue(PricingSide side, size_t level) const
+{
+    const long* quantities = GetSide(side).venueQuantities[level];
+    size_t largest = 0;
+    for (size_t i = 1; i < MARKET_COUNT; ++i)
     {
-        if (e.GetPrice() < best_offer.GetPrice())
-            best_offer = e;
+        if (quantities[i] > quantities[largest])
+            largest = i;
     }
-    return BidOffer(best_bid, best_offer);
+    return (Market)largest;
+}
+
+template<size_t N>
+const typename ConsolidatedBook<N>::Side& ConsolidatedBook<N>::GetSide(PricingSide side) const
+{
+    return side == BID ? bids : offers;
+}
+
+
+template<typename T>
+OrderBookDelta<T>::OrderBookDelta(const T& _product, Market _venue, uint64_t _sequence, PricingSide _side, BookAction _action, uint32_t _level,
+    TickPrice _price, long _quantity) :
+    product(&_product), venue(_venue), sequence(_sequence), side(_side), action(_action), level(_level), price(_price), quantity(_quantity)
+{
+}
+
+template<typename T>
+const T& OrderBookDelta<T>::GetProduct() const
+{
+    return *product;
+}
+
+template<typename T>
+Market OrderBookDelta<T>::GetVenue() const
+{
+    return venue;
+}
+
+template<typename T>
+uint64_t OrderBookDelta<T>::GetSequence() const
+{
+    return sequence;
+}
+
+template<typename T>
+PricingSide OrderBookDelta<T>::GetSide() const
+{
+    return side;
+}
+
+template<typename T>
+BookAction OrderBookDelta<T>::GetAction() const
+{
+    return action;
 }
 
-template <typename T>
-const OrderBook<T>& MarketDataService<T>::AggregateDepth(string productId)
+template<typename T>
+uint32_t OrderBookDelta<T>::GetLevel() const
 {
-    T product = orderbooks[productId].GetProduct();
-    vector<Order> bid_stack = orderbooks[productId].GetBidStack();
-    vector<Order> offer_stack = orderbooks[productId].GetOfferStack();
+    return level;
+}
 
-    unordered_map<double, long> bid_map, offer_map;
-    for (auto& e : bid_stack)
-        bid_map[e.GetPrice()] += e.GetQuantity();
-    for (auto& e : offer_stack)
-        offer_map[e.GetPrice()] += e.GetQuantity();
+template<typename T>
+TickPrice OrderBookDelta<T>::GetPrice() const
+{
+    return price;
+}
 
-    vector<Order> agg_bid_stack, agg_offer_stack;
-    for (auto& e : bid_map)
+template<typename T>
+long OrderBookDelta<T>::GetQuantity() const
+{
+    return quantity;
+}
+
+
+template<typename T>
+OrderBookUpdate<T>::OrderBookUpdate(const OrderBook<T>& _book, const OrderBookDelta<T>& _delta, uint32_t _firstLevel, uint32_t _endLevel,
+    uint32_t _previousBestLevel, uint32_t _bestLevel) :
+    book(&_book), delta(_delta), firstLevel(_firstLevel), endLevel(_endLevel), previousBestLevel(_previousBestLevel), bestLevel(_bestLevel)
+{
+}
+
+template<typename T>
+const OrderBook<T>& OrderBookUpdate<T>::GetBook() const
+{
+    return *book;
+}
+
+template<typename T>
+const OrderBookDelta<T>& OrderBookUpdate<T>::GetDelta() const
+{
+    return delta;
+}
+
+template<typename T>
+PricingSide OrderBookUpdate<T>::GetSide() const
+{
+    return delta.GetSide();
+}
+
+template<typename T>
+uint32_t OrderBookUpdate<T>::GetFirstLevel() const
+{
+    return firstLevel;
+}
+
+template<typename T>
+uint32_t OrderBookUpdate<T>::GetEndLevel() const
+{
+    return endLevel;
+}
+
+template<typename T>
+uint32_t OrderBookUpdate<T>::GetPreviousBestLevel() const
+{
+    return previousBestLevel;
+}
+
+template<typename T>
+uint32_t OrderBookUpdate<T>::GetBestLevel() const
+{
+    return bestLevel;
+}
+
+
+template <typename T, typename Chain>
+OrderBook<T>& MarketDataService<T, Chain>::GetData(string key)
+{
+    int productIndex = ProductIndex::Find(key);
+    if (productIndex < 0)
     {
-        Order bid(e.first, e.second, BID);
-        agg_bid_stack.push_back(bid);
+        empty_book = OrderBook<T>();
+        return empty_book;
     }
-    for (auto& e : offer_map)
+    return GetData(productIndex);
+}
+
+template <typename T, typename Chain>
+OrderBook<T>& MarketDataService<T, Chain>::GetData(int productIndex)
+{
+    return orderbooks[last_venues[productIndex]][productIndex];
+}
+
+template <typename T, typename Chain>
+OrderBook<T>& MarketDataService<T, Chain>::GetData(int productIndex, Market venue)
+{
+    return orderbooks[venue][productIndex];
+}
+
+template <typename T, typename Chain>
+void MarketDataService<T, Chain>::OnMessage(OrderBook<T>& data)
+{
+    SOA_LATENCY_SCOPE("MarketDataService::OnMessage");
+    orderbooks[data.GetVenue()][data.GetProduct().GetProductIndex()] = data;
+    UpdateViews(data);
+    Service<string, OrderBook<T>, Chain>::Notify(data);
+}
+
+template <typename T, typename Chain>
+void MarketDataService<T, Chain>::OnMessageBatch(vector<OrderBook<T> >& data)
+{
+    SOA_LATENCY_SCOPE("MarketDataService::OnMessageBatch");
+    for (auto& e : data)
     {
-        Order offer(e.first, e.second, OFFER);
-        agg_offer_stack.push_back(offer);
+        orderbooks[e.GetVenue()][e.GetProduct().GetProductIndex()] = e;
+        UpdateViews(e);
     }
-    return OrderBook<T>(product, agg_bid_stack, agg_offer_stack);
+    Service<string, OrderBook<T>, Chain>::NotifyBatch(data);
+}
+
+template <typename T, typename Chain>
+bool MarketDataService<T, Chain>::ApplyDelta(OrderBookDelta<T>& delta, OrderBookUpdate<T>& update)
+{
+    int index = delta.GetProduct().GetProductIndex();
+    Market venue = delta.GetVenue();
+    uint64_t& last_sequence = sequences[venue][index];
+    if (delta.GetSequence() <= last_sequence)
+        return false;
+    if (last_sequence != 0 && delta.GetSequence() != last_sequence + 1)
+        ++sequence_gaps;
+    last_sequence = delta.GetSequence();
+
+    OrderBook<T>& book = orderbooks[venue][index];
+    if (book.GetBidDepth() == 0 && book.GetOfferDepth() == 0)
+        book = OrderBook<T>(delta.GetProduct(), venue);
+    PricingSide side = delta.GetSide();
+    uint32_t level = delta.GetLevel();
+    uint32_t old_depth = (uint32_t)(side == BID ? book.GetBidDepth() : book.GetOfferDepth());
+    uint32_t previous_best = (uint32_t)(side == BID ? book.GetBestBidLevel() : book.GetBestOfferLevel());
+    bool applied = false;
+    uint32_t end_level = level + 1;
+    switch (delta.GetAction())
+    {
+    case LEVEL_INSERT:
+        applied = book.InsertLevel(side, level, delta.GetPrice(), delta.GetQuantity());
+        end_level = (uint32_t)(side == BID ? book.GetBidDepth() : book.GetOfferDepth());
+        break;
+    case LEVEL_UPDATE:
+        applied = book.UpdateLevel(side, level, delta.GetPrice(), delta.GetQuantity());
+        break;
+    case LEVEL_DELETE:
+        applied = book.DeleteLevel(side, level);
+        end_level = old_depth;
+        break;
+    }
+    if (applied)
+    {
+        // only this venue's side changed
+        ConsolidatedBook<>& consolidated_book = consolidated[index];
+        consolidated_book.Update(book, side);
+        best_bid_offers.Store(index, consolidated_book.GetBestBidOffer());
+        last_venues[index] = venue;
+        uint32_t best = (uint32_t)(side == BID ? book.GetBestBidLevel() : book.GetBestOfferLevel());
+        update = OrderBookUpdate<T>(book, delta, level, end_level, previous_best, best);
+    }
+    return applied;
+}
+
+template <typename T, typename Chain>
+void MarketDataService<T, Chain>::UpdateViews(const OrderBook<T>& book)
+{
+    int index = book.GetProduct().GetProductIndex();
+    ConsolidatedBook<>& consolidated_book = consolidated[index];
+    consolidated_book.Update(book);
+    best_bid_offers.Store(index, consolidated_book.GetBestBidOffer());
+    last_venues[index] = book.GetVenue();
+}
+
+template <typename T, typename Chain>
+void MarketDataService<T, Chain>::OnDelta(OrderBookDelta<T>& delta)
+{
+    SOA_LATENCY_SCOPE("MarketDataService::OnDelta");
+    OrderBookUpdate<T> update;
+    if (!ApplyDelta(delta, update))
+        return;
+    for (auto& e : update_listeners)
+        e->ProcessAdd(update);
+}
+
+template <typename T, typename Chain>
+void MarketDataService<T, Chain>::OnDeltaBatch(vector<OrderBookDelta<T> >& deltas)
+{
+    SOA_LATENCY_SCOPE("MarketDataService::OnDeltaBatch");
+    updates.clear();
+    if (deltas.empty())
+        return;
+    // size the tables up front, the updates point into them and must not move
+    int max_index = 0;
+    for (auto& e : deltas)
+        max_index = max(max_index, e.GetProduct().GetProductIndex());
+    for (size_t i = 0; i < MARKET_COUNT; ++i)
+    {
+        orderbooks[i][max_index];
+        sequences[i][max_index];
+    }
+
+    OrderBookUpdate<T> update;
+    for (auto& e : deltas)
+    {
+        if (ApplyDelta(e, update))
+            updates.push_back(update);
+    }
+    if (updates.empty())
+        return;
+    for (auto& e : update_listeners)
+        e->ProcessAddBatch(updates);
+}
+
+template <typename T, typename Chain>
+void MarketDataService<T, Chain>::AddUpdateListener(ServiceListener<OrderBookUpdate<T> >* listener)
+{
+    update_listeners.push_back(listener);
+}
+
+template <typename T, typename Chain>
+OrderBook<T> MarketDataService<T, Chain>::GetSnapshot(string productId, Market venue)
+{
+    const OrderBook<T>* book = orderbooks[venue].Find(ProductIndex::Find(productId));
+    return book == nullptr ? OrderBook<T>() : *book;
+}
+
+template <typename T, typename Chain>
+uint64_t MarketDataService<T, Chain>::GetSequence(string productId, Market venue)
+{
+    const uint64_t* sequence = sequences[venue].Find(ProductIndex::Find(productId));
+    return sequence == nullptr ? 0 : *sequence;
+}
+
+template <typename T, typename Chain>
+uint64_t MarketDataService<T, Chain>::GetSequenceGapCount() const
+{
+    return sequence_gaps;
+}
+
+template <typename T, typename Chain>
+BidOffer MarketDataService<T, Chain>::GetBestBidOffer(string productId) const
+{
+    return GetBestBidOffer(ProductIndex::Find(productId));
+}
+
+template <typename T, typename Chain>
+BidOffer MarketDataService<T, Chain>::GetBestBidOffer(int productIndex) const
+{
+    BidOffer bid_offer(Order(TickPrice(), 0, BID), Order(TickPrice(), 0, OFFER));
+    best_bid_offers.Load(productIndex, bid_offer);
+    return bid_offer;
+}
+
+template <typename T, typename Chain>
+const AggregatedDepth<>& MarketDataService<T, Chain>::GetAggregatedDepth(string productId, Market venue)
+{
+    int productIndex = ProductIndex::Find(productId);
+    if (productIndex < 0)
+        return empty_consolidated.GetVenueDepth(venue);
+    return GetAggregatedDepth(productIndex, venue);
+}
+
+template <typename T, typename Chain>
+const AggregatedDepth<>& MarketDataService<T, Chain>::GetAggregatedDepth(int productIndex, Market venue)
+{
+    return consolidated[productIndex].GetVenueDepth(venue);
+}
+
+template <typename T, typename Chain>
+const ConsolidatedBook<>& MarketDataService<T, Chain>::GetConsolidatedBook(string productId)
+{
+    int productIndex = ProductIndex::Find(productId);
+    if (productIndex < 0)
+        return empty_consolidated;
+    return GetConsolidatedBook(productIndex);
+}
+
+template <typename T, typename Chain>
+const ConsolidatedBook<>& MarketDataService<T, Chain>::GetConsolidatedBook(int productIndex)
+{
+    ConsolidatedBook<>& book = consolidated[productIndex];
+    book.Consolidate();
+    return book;
+}
+
+template <typename T, typename Chain>
+OrderBook<T> MarketDataService<T, Chain>::AggregateDepth(string productId)
+{
+    // only a book that arrived has a product, the default one of the table has none
+    int productIndex = ProductIndex::Find(productId);
+    const Market* venue = last_venues.Find(productIndex);
+    if (venue == nullptr)
+        return OrderBook<T>();
+    const ConsolidatedBook<>& book = GetConsolidatedBook(productIndex);
+    OrderBook<T> aggregated(GetData(productIndex, *venue).GetProduct());
+    for (size_t i = 0; i < book.GetLevelCount(BID); ++i)
+        aggregated.AddBid(book.GetPrice(BID, i), book.GetQuantity(BID, i));
+    for (size_t i = 0; i < book.GetLevelCount(OFFER); ++i)
+        aggregated.AddOffer(book.GetPrice(OFFER, i), book.GetQuantity(OFFER, i));
+    return aggregated;
 }
 
 #endif
@@ -0,0 +1,197 @@
+
+#ifndef ORDERED_CHUNK_PARSER_HPP
+#define ORDERED_CHUNK_PARSER_HPP
+
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Run task_count tasks on a pool of workers and hand their results on in task order.
+// produce(size_t task, S& slot) fills a slot on a worker; deliver(S& slot) is called on the
+// calling thread for each task in order. Slots are reused, up to 2 * workers exist at a time.
+// Rethrows the first exception thrown by produce or deliver.
+template<typename S, typename Produce, typename Deliver>
+void RunOrdered(size_t task_count, size_t workers, Produce produce, Deliver deliver);
+
+
+/**
+ * Parses a text block on a pool of worker threads and delivers the results in the original order.
+ * The block is cut into chunks of about chunk_bytes that end on line boundaries. Workers parse
+ * chunks into a ring of record buffers, which are reused for the whole run, and the calling
+ * thread acts as the sequencer, handing each chunk's records on in file order.
+ * Type R is the record type.
+ */
+template<typename R>
+class OrderedChunkParser
+{
+public:
+    // ctor for a parser of data, split into chunks of about chunk_bytes
+    OrderedChunkParser(string_view _data, size_t _workers, size_t _chunk_bytes);
+
+    // Get the number of chunks
+    size_t GetChunkCount() const;
+
+    // Parse every chunk with parse(string_view chunk, vector<R>& records) on the workers and call
+    // deliver(vector<R>& records) on the calling thread for each chunk in order.
+    // Rethrows the first exception thrown by parse or deliver.
+    template<typename Parse, typename Deliver>
+    void Run(Parse parse, Deliver deliver);
+
+private:
+    string_view data;
+    size_t workers;
+    vector<size_t> boundaries;  // chunk i covers [boundaries[i], boundaries[i + 1])
+};
+
+
+template<typename S, typename Produce, typename Deliver>
+void RunOrdered(size_t task_count, size_t workers, Produce produce, Deliver deliver)
+{
+    struct Slot
+    {
+        S result;
+        size_t task;            // task held by the slot, valid once ready is set
+        bool ready;
+    };
+
+    if (workers < 1)
+        workers = 1;
+    const size_t slot_count = 2 * workers;
+    vector<Slot> slots(slot_count);
+    for (auto& e : slots)
+        e.ready = false;
+
+    mutex state_mutex;
+    condition_variable ready_cv;        // a slot has been produced
+    condition_variable freed_cv;        // a slot has been delivered
+    size_t next_task = 0;
+    size_t delivered = 0;
+    bool stop = false;
+    exception_ptr error;
+
+    auto fail = [&](exception_ptr e)
+    {
+        lock_guard<mutex> lock(state_mutex);
+        if (!error)
+            error = e;
+        stop = true;
+        ready_cv.notify_all();
+        freed_cv.notify_all();
+    };
+
+    auto work = [&]()
+    {
+        while (true)
+        {
+            size_t task;
+            {
+                unique_lock<mutex> lock(state_mutex);
+                if (stop || next_task >= task_count)
+                    return;
+                task = next_task++;
+                // the slot is free once the task slot_count before this one has been delivered
+                freed_cv.wait(lock, [&]() { return stop || task < delivered + slot_count; });
+                if (stop)
+                    return;
+            }
+            Slot& slot = slots[task % slot_count];
+            try
+            {
+                produce(task, slot.result);
+            }
+            catch (...)
+            {
+                fail(current_exception());
+                return;
+            }
+            {
+                lock_guard<mutex> lock(state_mutex);
+                slot.task = task;
+                slot.ready = true;
+            }
+            ready_cv.notify_all();
+        }
+    };
+
+    vector<thread> threads;
+    for (size_t i = 0; i < workers && i < task_count; ++i)
+        threads.emplace_back(work);
+
+    for (size_t task = 0; task < task_count; ++task)
+    {
+        Slot& slot = slots[task % slot_count];
+        {
+            unique_lock<mutex> lock(state_mutex);
+            ready_cv.wait(lock, [&]() { return stop || (slot.ready && slot.task == task); });
+            if (stop)
+                break;
+        }
+        try
+        {
+            deliver(slot.result);
+        }
+        catch (...)
+        {
+            fail(current_exception());
+            break;
+        }
+        {
+            lock_guard<mutex> lock(state_mutex);
+            slot.ready = false;
+            delivered = task + 1;
+        }
+        freed_cv.notify_all();
+    }
+
+    for (auto& t : threads)
+        t.join();
+    if (error)
+        rethrow_exception(error);
+}
+
+
+template<typename R>
+OrderedChunkParser<R>::OrderedChunkParser(string_view _data, size_t _workers, size_t _chunk_bytes) :
+    data(_data), workers(_workers < 1 ? 1 : _workers)
+{
+    size_t start = 0;
+    boundaries.push_back(0);
+    while (start < data.size())
+    {
+        size_t end = start + (_chunk_bytes < 1 ? 1 : _chunk_bytes);
+        if (end >= data.size())
+            end = data.size();
+        else
+        {
+            const char* newline = (const char*)memchr(data.data() + end - 1, '\n', data.size() - end + 1);
+            end = newline == nullptr ? data.size() : (size_t)(newline - data.data()) + 1;
+        }
+        boundaries.push_back(end);
+        start = end;
+    }
+}
+
+template<typename R>
+size_t OrderedChunkParser<R>::GetChunkCount() const
+{
+    return boundaries.size() - 1;
+}
+
+template<typename R>
+template<typename Parse, typename Deliver>
+void OrderedChunkParser<R>::Run(Parse parse, Deliver deliver)
+{
+    RunOrdered<vector<R> >(GetChunkCount(), workers, [&](size_t chunk, vector<R>& records)
+    {
+        records.clear();
+        parse(data.substr(boundaries[chunk], boundaries[chunk + 1] - boundaries[chunk]), records);
+    }, deliver);
+}
+
+#endif
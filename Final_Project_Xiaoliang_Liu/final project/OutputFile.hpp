@@ -0,0 +1,476 @@
+
+#ifndef OUTPUT_FILE_HPP
+#define OUTPUT_FILE_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Buffering of output files
+struct OutputOptions
+{
+    size_t buffer_bytes = 1 << 20;                      // a full buffer is handed to the flusher
+    size_t max_pending = 4;                             // full buffers queued per file before writers wait
+    chrono::milliseconds flush_interval{ 100 };         // partly filled buffers are written after this long
+};
+
+class OutputRegistry;
+
+
+/**
+ * An output file kept open in append mode for the whole run.
+ * Records are formatted through an ostream straight into a large reusable buffer. Full buffers
+ * are queued for the flusher thread of the OutputRegistry, which writes them with one writev()
+ * call, so a writer only pays for formatting. The file is created on the first write, and the
+ * bytes reach it in the order they were formatted.
+ * Write records through an OutputWriter.
+ */
+class OutputFile : private streambuf
+{
+public:
+    // ctor for a file, nothing is opened until there is data to write
+    OutputFile(const string& _file_name, const OutputOptions& _options, OutputRegistry& _registry);
+    ~OutputFile();
+
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    // Get the name of the file
+    const string& GetFileName() const;
+
+    // Write the queued buffers to the file, and also the partly filled one if partial is set
+    void Flush(bool partial);
+
+private:
+    friend class OutputWriter;
+
+    struct Buffer
+    {
+        vector<char> data;
+        size_t size;
+    };
+
+    string file_name;
+    OutputOptions options;
+    OutputRegistry& registry;
+    ostream stream;
+    int fd;
+    bool failed;                    // the file could not be opened or written, later data is dropped
+
+    mutex buffer_mutex;             // guards the buffers below and the stream
+    unique_lock<mutex> writer_lock; // held by the current OutputWriter
+    condition_variable freed_cv;    // queued buffers have been written
+    Buffer current;
+    vector<Buffer> pending;         // full buffers waiting for the flusher, oldest first
+    vector<Buffer> spare;
+
+    mutex write_mutex;              // guards the file and the buffers being written
+    vector<Buffer> writing;
+#ifndef _WIN32
+    vector<iovec> iov;
+#endif
+
+    // Lock the stream for a writer
+    void Lock();
+
+    // Unlock the stream
+    void Unlock();
+
+    // Queue the current buffer and start an empty one, buffer_mutex must be held
+    void HandOff();
+
+    // Make room in the current buffer, waiting for the flusher while too many buffers are queued
+    void MakeRoom();
+
+    // Write buffers to the file in order
+    void WriteBuffers(vector<Buffer>& buffers);
+
+    int overflow(int c) override;
+    streamsize xsputn(const char* s, streamsize n) override;
+    int sync() override;
+};
+
+
+/**
+ * Locks an OutputFile for the records of one call and gives the stream to format them into.
+ */
+class OutputWriter
+{
+public:
+    // ctor, locks the file
+    OutputWriter(OutputFile& _file);
+    ~OutputWriter();
+
+    OutputWriter(const OutputWriter&) = delete;
+    OutputWriter& operator=(const OutputWriter&) = delete;
+
+    // Get the stream of the file
+    ostream& Stream();
+
+private:
+    OutputFile& file;
+};
+
+
+/**
+ * Keeps one OutputFile per path for the whole process and runs the thread that flushes them.
+ * The flusher writes a file's buffers as soon as one fills up, and every flush_interval also
+ * writes the partly filled ones. Everything still buffered is written by Flush() and at exit.
+ */
+class OutputRegistry
+{
+public:
+    ~OutputRegistry();
+
+    // Get the registry
+    static OutputRegistry& Instance();
+
+    // Set the buffering, sizes apply to files first used after the call
+    void SetOptions(const OutputOptions& _options);
+
+    // Get the output file of a path, creating it if needed. The reference stays valid.
+    OutputFile& Get(const string& file_name);
+
+    // Write everything buffered so far in every file
+    void Flush();
+
+private:
+    friend class OutputFile;
+
+    map<string, unique_ptr<OutputFile> > files;
+    OutputOptions options;
+    mutex registry_mutex;           // guards files and options
+
+    thread flusher;
+    mutex flusher_mutex;
+    condition_variable flusher_cv;
+    bool wake;                      // a file has a full buffer
+    bool stop;
+
+    // ctor, starts the flusher thread
+    OutputRegistry();
+
+    // Tell the flusher a buffer is full
+    void Wake();
+
+    // Flush every file
+    void FlushFiles(bool partial);
+
+    // Flusher thread loop
+    void RunFlusher();
+};
+
+
+OutputFile::OutputFile(const string& _file_name, const OutputOptions& _options, OutputRegistry& _registry) :
+    file_name(_file_name), options(_options), registry(_registry), stream(this), fd(-1), failed(false),
+    writer_lock(buffer_mutex, defer_lock)
+{
+    if (options.buffer_bytes < 1)
+        options.buffer_bytes = 1;
+    if (options.max_pending < 1)
+        options.max_pending = 1;
+    current.data.resize(options.buffer_bytes);
+    current.size = 0;
+    setp(current.data.data(), current.data.data() + current.data.size());
+}
+
+OutputFile::~OutputFile()
+{
+    Flush(true);
+#ifdef _WIN32
+    if (fd >= 0)
+        _close(fd);
+#else
+    if (fd >= 0)
+        close(fd);
+#endif
+}
+
+const string& OutputFile::GetFileName() const
+{
+    return file_name;
+}
+
+void OutputFile::Flush(bool partial)
+{
+    // write_mutex is taken first, so two flushes can not reorder the buffers
+    lock_guard<mutex> write_lock(write_mutex);
+    {
+        lock_guard<mutex> lock(buffer_mutex);
+        if (partial && pptr() > pbase())
+            HandOff();
+        writing.swap(pending);
+    }
+    if (writing.empty())
+        return;
+    WriteBuffers(writing);
+    {
+        lock_guard<mutex> lock(buffer_mutex);
+        for (auto& e : writing)
+            spare.push_back(move(e));
+    }
+    writing.clear();
+    freed_cv.notify_all();
+}
+
+void OutputFile::Lock()
+{
+    // writer_lock is only touched by the thread holding the mutex
+    buffer_mutex.lock();
+    writer_lock = unique_lock<mutex>(buffer_mutex, adopt_lock);
+}
+
+void OutputFile::Unlock()
+{
+    writer_lock.release();
+    buffer_mutex.unlock();
+}
+
+void OutputFile::HandOff()
+{
+    current.size = pptr() - pbase();
+    pending.push_back(move(current));
+    if (spare.empty())
+    {
+        current.data.resize(options.buffer_bytes);
+    }
+    else
+    {
+        current = move(spare.back());
+        spare.pop_back();
+    }
+    current.size = 0;
+    setp(current.data.data(), current.data.data() + current.data.size());
+}
+
+void OutputFile::MakeRoom()
+{
+    while (pptr() == epptr())
+    {
+        registry.Wake();
+        if (pending.size() < options.max_pending)
+            HandOff();
+        else
+            freed_cv.wait(writer_lock);
+    }
+}
+
+void OutputFile::WriteBuffers(vector<Buffer>& buffers)
+{
+    if (failed)
+        return;
+    if (fd < 0)
+    {
+#ifdef _WIN32
+        fd = _open(file_name.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND, _S_IREAD | _S_IWRITE);
+#else
+        fd = open(file_name.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+#endif
+        if (fd < 0)
+        {
+            failed = true;
+            cout << "ERROR: File " << file_name << " can not be opened.\n";
+            return;
+        }
+    }
+
+#ifdef _WIN32
+    for (auto& e : buffers)
+    {
+        size_t done = 0;
+        while (done < e.size)
+        {
+            int n = _write(fd, e.data.data() + done, (unsigned)(e.size - done));
+            if (n <= 0)
+            {
+                failed = true;
+                cout << "ERROR: File " << file_name << " could not be written.\n";
+                return;
+            }
+            done += n;
+        }
+    }
+#else
+    iov.clear();
+    for (auto& e : buffers)
+    {
+        if (e.size > 0)
+            iov.push_back(iovec{ e.data.data(), e.size });
+    }
+    size_t next = 0;
+    while (next < iov.size())
+    {
+        ssize_t n = writev(fd, iov.data() + next, (int)min(iov.size() - next, (size_t)IOV_MAX));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            failed = true;
+            cout << "ERROR: File " << file_name << " could not be written.\n";
+            return;
+        }
+        // skip what was written, a short write leaves the rest of a buffer for the next call
+        size_t written = (size_t)n;
+        while (next < iov.size() && written >= iov[next].iov_len)
+            written -= iov[next++].iov_len;
+        if (written > 0)
+        {
+            iov[next].iov_base = (char*)iov[next].iov_base + written;
+            iov[next].iov_len -= written;
+        }
+    }
+#endif
+}
+
+int OutputFile::overflow(int c)
+{
+    MakeRoom();
+    if (c != traits_type::eof())
+    {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+streamsize OutputFile::xsputn(const char* s, streamsize n)
+{
+    streamsize done = 0;
+    while (done < n)
+    {
+        MakeRoom();
+        size_t count = min((size_t)(n - done), (size_t)(epptr() - pptr()));
+        memcpy(pptr(), s + done, count);
+        pbump((int)count);
+        done += count;
+    }
+    return n;
+}
+
+int OutputFile::sync()
+{
+    // endl only ends the line, the flusher decides when data is written
+    return 0;
+}
+
+
+OutputWriter::OutputWriter(OutputFile& _file) : file(_file)
+{
+    file.Lock();
+}
+
+OutputWriter::~OutputWriter()
+{
+    file.Unlock();
+}
+
+ostream& OutputWriter::Stream()
+{
+    return file.stream;
+}
+
+
+OutputRegistry::OutputRegistry() : wake(false), stop(false)
+{
+    flusher = thread(&OutputRegistry::RunFlusher, this);
+}
+
+OutputRegistry::~OutputRegistry()
+{
+    {
+        lock_guard<mutex> lock(flusher_mutex);
+        stop = true;
+    }
+    flusher_cv.notify_all();
+    flusher.join();
+    FlushFiles(true);
+}
+
+OutputRegistry& OutputRegistry::Instance()
+{
+    static OutputRegistry registry;
+    return registry;
+}
+
+void OutputRegistry::SetOptions(const OutputOptions& _options)
+{
+    lock_guard<mutex> lock(registry_mutex);
+    lock_guard<mutex> flusher_lock(flusher_mutex);
+    options = _options;
+}
+
+OutputFile& OutputRegistry::Get(const string& file_name)
+{
+    lock_guard<mutex> lock(registry_mutex);
+    unique_ptr<OutputFile>& file = files[file_name];
+    if (!file)
+        file.reset(new OutputFile(file_name, options, *this));
+    return *file;
+}
+
+void OutputRegistry::Flush()
+{
+    FlushFiles(true);
+}
+
+void OutputRegistry::Wake()
+{
+    {
+        lock_guard<mutex> lock(flusher_mutex);
+        wake = true;
+    }
+    flusher_cv.notify_one();
+}
+
+void OutputRegistry::FlushFiles(bool partial)
+{
+    vector<OutputFile*> snapshot;
+    {
+        lock_guard<mutex> lock(registry_mutex);
+        for (auto& e : files)
+            snapshot.push_back(e.second.get());
+    }
+    for (auto file : snapshot)
+        file->Flush(partial);
+}
+
+void OutputRegistry::RunFlusher()
+{
+    unique_lock<mutex> lock(flusher_mutex);
+    auto next_partial = chrono::steady_clock::now() + options.flush_interval;
+    while (!stop)
+    {
+        flusher_cv.wait_until(lock, next_partial, [&]() { return wake || stop; });
+        wake = false;
+        bool partial = chrono::steady_clock::now() >= next_partial;
+        if (partial)
+            next_partial = chrono::steady_clock::now() + options.flush_interval;
+        lock.unlock();
+        FlushFiles(partial);
+        lock.lock();
+    }
+}
+
+#endif
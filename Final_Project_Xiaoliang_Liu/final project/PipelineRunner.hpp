@@ -0,0 +1,87 @@
+
+#ifndef PIPELINE_RUNNER_HPP
+#define PIPELINE_RUNNER_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <functional>
+#include <exception>
+#include <boost/date_time.hpp>
+
+using namespace std;
+using namespace boost::posix_time;
+
+/**
+ * Runs each feed pipeline (typically one Connector::Subscribe call) on its own thread
+ * and waits for all of them, so a full replay takes about as long as the longest pipeline.
+ * Pipelines that meet downstream must share services that are safe for concurrent callers,
+ * e.g. TradeBookingService, which both the trade feed and the execution path write to.
+ */
+class PipelineRunner
+{
+public:
+    // ctor
+    PipelineRunner() = default;
+
+    // Add a pipeline to run
+    void Add(string name, function<void()> pipeline);
+
+    // Run all pipelines concurrently and wait for them to finish
+    // Rethrows the first exception raised by a pipeline
+    void Run();
+
+private:
+    vector<string> names;
+    vector<function<void()> > pipelines;
+};
+
+
+void PipelineRunner::Add(string name, function<void()> pipeline)
+{
+    names.push_back(name);
+    pipelines.push_back(pipeline);
+}
+
+void PipelineRunner::Run()
+{
+    vector<thread> threads;
+    vector<exception_ptr> errors(pipelines.size());
+    ptime start_time = microsec_clock::local_time();
+
+    for (size_t i = 0; i < pipelines.size(); ++i)
+    {
+        threads.emplace_back([this, i, &errors]()
+        {
+            ptime begin = microsec_clock::local_time();
+            try
+            {
+                pipelines[i]();
+            }
+            catch (...)
+            {
+                errors[i] = current_exception();
+            }
+            // timestamps are formatted to strings first, streaming a ptime changes cout's format
+            // state and so is not safe from several threads
+            ptime end = microsec_clock::local_time();
+            cout << to_simple_string(end) << "  Pipeline " << names[i] << " finished in "
+                << to_simple_string(end - begin) << ".\n";
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+
+    ptime end_time = microsec_clock::local_time();
+    cout << to_simple_string(end_time) << "  All pipelines finished in "
+        << to_simple_string(end_time - start_time) << ".\n\n";
+
+    for (auto& e : errors)
+    {
+        if (e)
+            rethrow_exception(e);
+    }
+}
+
+#endif
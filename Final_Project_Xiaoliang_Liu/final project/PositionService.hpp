@@ -6,6 +6,7 @@
 #include <string>
 #include <map>
 #include "SOA.hpp"
+#include "Products.hpp"
 #include "TradeBookingService.hpp"
 
 using namespace std;
@@ -14,7 +15,7 @@ template<typename T>
 class Position
 {
 public:
-    // ctor
+    // ctor, the product is referenced and must outlive the position
     Position() = default;
     Position(const T& _product);
 
@@ -34,7 +35,7 @@ public:
     void UpdatePosition(string& book, double quantity, Side side);
 
 private:
-    T product;
+    const T* product = nullptr;
     map<string, double> positions;
 };
 
@@ -42,14 +43,14 @@ private:
 
 /**
  * Position Service to manage positions across multiple books and secruties.
- * Keyed on product identifier.
- * Type T is the product type.
+ * Keyed on product identifier, stored by product index.
+ * Type T is the product type, Chain the compile-time listener chain.
  */
-template<typename T>
-class PositionService : public Service<string, Position <T> >
+template<typename T, typename Chain = ListenerChain<Position<T> > >
+class PositionService : public Service<string, Position <T>, Chain>
 {
 private:
-    map<string, Position<T> > positions;
+    ProductTable<Position<T> > positions;
 
 public:
     // default constructor
@@ -58,21 +59,27 @@ public:
     // Add a trading record to the service
     void AddTrade(const Trade<T>& trade);
 
+    // Add a block of trading records to the service, notifying one position per trade
+    void AddTradeBatch(const vector<Trade<T> >& trades);
+
     // Get data on our service given a key
     Position <T>& GetData(string key);
 
+    // Get data on our service given a product index
+    Position <T>& GetData(int productIndex);
+
     // The callback that a Connector should invoke for any new or updated data
     void OnMessage(Position<T>& data);
 };
 
 
 template <typename T>
-Position<T>::Position(const T& _product): product(_product) {}
+Position<T>::Position(const T& _product): product(&_product) {}
 
 template<typename T>
 const T& Position<T>::GetProduct() const
 {
-    return product;
+    return *product;
 }
 
 template<typename T>
@@ -108,39 +115,64 @@ void Position<T>::UpdatePosition(string& book, double quantity, Side side)
 }
 
 
-template <typename T>
-Position<T>& PositionService<T>::GetData(string key)
+template <typename T, typename Chain>
+Position<T>& PositionService<T, Chain>::GetData(string key)
 {
     return positions[key];
 }
 
-template<typename T>
-void PositionService<T>::OnMessage(Position<T>& data)
+template <typename T, typename Chain>
+Position<T>& PositionService<T, Chain>::GetData(int productIndex)
 {
-    positions[data.GetProduct().GetProductId()] = data;
+    return positions[productIndex];
 }
 
-template <typename T>
-void PositionService<T>::AddTrade(const Trade<T>& trade)
+template<typename T, typename Chain>
+void PositionService<T, Chain>::OnMessage(Position<T>& data)
 {
-    T product = trade.GetProduct();
-    string product_id = product.GetProductId();
+    positions[data.GetProduct().GetProductIndex()] = data;
+}
+
+template <typename T, typename Chain>
+void PositionService<T, Chain>::AddTrade(const Trade<T>& trade)
+{
+    const T& product = trade.GetProduct();
     string book = trade.GetBook();
     double quantity = trade.GetQuantity();
     Side side = trade.GetSide();
 
-    if (positions.find(product_id) != positions.end())
+    Position<T>* pos = positions.Find(product.GetProductIndex());
+    if (pos == nullptr)
     {
-        positions[product_id].UpdatePosition(book, quantity, side);
+        pos = &positions[product.GetProductIndex()];
+        *pos = Position<T>(product);
     }
-    else
+    pos->UpdatePosition(book, quantity, side);
+
+    Service<string, Position <T>, Chain>::Notify(*pos);
+}
+
+template <typename T, typename Chain>
+void PositionService<T, Chain>::AddTradeBatch(const vector<Trade<T> >& trades)
+{
+    vector<Position<T> > updates;
+    updates.reserve(trades.size());
+
+    for (auto& trade : trades)
     {
-        Position<T> pos(product);
-        pos.UpdatePosition(book, quantity, side);
-        positions.insert(pair<string, Position<T>>(product_id, pos));
+        const T& product = trade.GetProduct();
+        Position<T>* pos = positions.Find(product.GetProductIndex());
+        if (pos == nullptr)
+        {
+            pos = &positions[product.GetProductIndex()];
+            *pos = Position<T>(product);
+        }
+        string book = trade.GetBook();
+        pos->UpdatePosition(book, trade.GetQuantity(), trade.GetSide());
+        updates.push_back(*pos);
     }
 
-    Service<string, Position <T> >::Notify(positions[product_id]);
+    Service<string, Position <T>, Chain>::NotifyBatch(updates);
 }
 
 #endif
@@ -5,47 +5,55 @@
 #include <string>
 #include <map>
 #include "SOA.hpp"
+#include "Products.hpp"
+#include "TickPrice.hpp"
 
 using namespace std;
 
 /**
- * A price object consisting of mid and bid/offer spread.
+ * A price object consisting of a bid and an offer, quoted as mid and bid/offer spread.
  * Type T is the product type.
  */
 template<typename T>
 class Price
 {
 public:
-    // ctor for a price
+    // ctor for a price, the product is referenced and must outlive the price
     Price() = default;
-    Price(const T& _product, double _mid, double _bidOfferSpread);
+    Price(const T& _product, TickPrice _bid, TickPrice _offer);
 
     // Get the product
     const T& GetProduct() const;
 
-    // Get the mid price
+    // Get the mid price, which can fall on a half tick and so is returned as a number
     double GetMid() const;
 
     // Get the bid/offer spread around the mid
-    double GetBidOfferSpread() const;
+    TickPrice GetBidOfferSpread() const;
+
+    // Get the bid price
+    TickPrice GetBid() const;
+
+    // Get the offer price
+    TickPrice GetOffer() const;
 
 private:
-    T product;
-    double mid;
-    double bidOfferSpread;
+    const T* product = nullptr;
+    TickPrice bid;
+    TickPrice offer;
 };
 
 
 /**
  * Pricing Service managing mid prices and bid/offers.
- * Keyed on product identifier.
- * Type T is the product type.
+ * Keyed on product identifier, stored by product index.
+ * Type T is the product type, Chain the compile-time listener chain.
  */
-template<typename T>
-class PricingService : public Service<string, Price <T> >
+template<typename T, typename Chain = ListenerChain<Price<T> > >
+class PricingService : public Service<string, Price <T>, Chain>
 {
 private:
-    map<string, Price<T>> prices;
+    ProductTable<Price<T> > prices;
     
 public:
     // ctor
@@ -54,49 +62,81 @@ public:
     // Get data on our service given a key
     Price<T>& GetData(string key);
 
+    // Get data on our service given a product index
+    Price<T>& GetData(int productIndex);
+
     // The callback that a Connector should invoke for any new or updated data
     void OnMessage(Price<T>& data);
+
+    // The callback that a Connector should invoke for a block of new or updated data
+    void OnMessageBatch(vector<Price<T> >& data);
 };
 
 
 template<typename T>
-Price<T>::Price(const T& _product, double _mid, double _bidOfferSpread) :
-    product(_product)
+Price<T>::Price(const T& _product, TickPrice _bid, TickPrice _offer) :
+    product(&_product), bid(_bid), offer(_offer)
 {
-    mid = _mid;
-    bidOfferSpread = _bidOfferSpread;
 }
 
 template<typename T>
 const T& Price<T>::GetProduct() const
 {
-    return product;
+    return *product;
 }
 
 template<typename T>
 double Price<T>::GetMid() const
 {
-    return mid;
+    return (double)(bid + offer).GetTicks() / (2 * TICKS_PER_POINT);
+}
+
+template<typename T>
+TickPrice Price<T>::GetBidOfferSpread() const
+{
+    return offer - bid;
 }
 
 template<typename T>
-double Price<T>::GetBidOfferSpread() const
+TickPrice Price<T>::GetBid() const
 {
-    return bidOfferSpread;
+    return bid;
 }
 
+template<typename T>
+TickPrice Price<T>::GetOffer() const
+{
+    return offer;
+}
 
-template <typename T>
-Price<T>& PricingService<T>::GetData(string key)
+
+template <typename T, typename Chain>
+Price<T>& PricingService<T, Chain>::GetData(string key)
 {
     return prices[key];
 }
 
-template <typename T>
-void PricingService<T>::OnMessage(Price<T>& data)
+template <typename T, typename Chain>
+Price<T>& PricingService<T, Chain>::GetData(int productIndex)
+{
+    return prices[productIndex];
+}
+
+template <typename T, typename Chain>
+void PricingService<T, Chain>::OnMessage(Price<T>& data)
+{
+    SOA_LATENCY_SCOPE("PricingService::OnMessage");
+    prices[data.GetProduct().GetProductIndex()] = data;
+    Service<string, Price<T>, Chain>::Notify(data);
+}
+
+template <typename T, typename Chain>
+void PricingService<T, Chain>::OnMessageBatch(vector<Price<T> >& data)
 {
-    prices[data.GetProduct().GetProductId()] = data;
-    Service<string, Price<T> >::Notify(data);
+    SOA_LATENCY_SCOPE("PricingService::OnMessageBatch");
+    for (auto& e : data)
+        prices[e.GetProduct().GetProductIndex()] = e;
+    Service<string, Price<T>, Chain>::NotifyBatch(data);
 }
 
 #endif
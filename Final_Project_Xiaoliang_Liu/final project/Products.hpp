@@ -5,6 +5,12 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <shared_mutex>
 #include "boost/date_time/gregorian/gregorian.hpp"
 
 using namespace std;
@@ -12,6 +18,89 @@ using namespace boost::gregorian;
 
 enum ProductType { IRSWAP, BOND };
 
+
+/**
+ * Interns product identifiers into dense integer indices 0, 1, 2, ... in order of first use.
+ * Products should be interned at load time so per-message lookups only read the table.
+ * Safe for concurrent callers.
+ */
+class ProductIndex
+{
+public:
+    // Get the index of a product identifier, assigning the next index if it is new
+    static int Intern(const string& productId);
+
+    // Get the index of a product identifier, -1 if it has not been interned
+    static int Find(const string& productId);
+
+    // Get the product identifier of an index
+    static const string& GetProductId(int index);
+
+    // Get the number of interned products
+    static int Size();
+
+private:
+    static unordered_map<string, int>& Indices();
+    static deque<string>& ProductIds();
+    static shared_mutex& Mutex();
+};
+
+
+/**
+ * Flat per-product table indexed by ProductIndex, used by services in place of a map
+ * keyed on product identifier. Grows on demand.
+ * Type V is the stored value type.
+ */
+template<typename V>
+class ProductTable
+{
+public:
+    // Get the slot of a product index, creating it if needed
+    V& operator[](int index);
+
+    // Get the slot of a product identifier (slower compatibility path)
+    V& operator[](const string& productId);
+
+    // Get the slot of a product index, nullptr if nothing was stored for it
+    V* Find(int index);
+
+    // Get the number of slots
+    int Size() const;
+
+private:
+    vector<V> slots;
+    vector<bool> stored;
+};
+
+
+/**
+ * Reference data catalog owning one immutable product per instrument.
+ * Events reference the products held here instead of carrying their own copy, so every
+ * product is added at load time, before events are built. Lookups do not lock or allocate.
+ * Type T is the product type.
+ */
+template<typename T>
+class ProductCatalog
+{
+public:
+    // Add a product, returns the catalog-owned product (the existing one if already added)
+    const T& Add(const T& product);
+
+    // Get a product by identifier, nullptr if it is not in the catalog
+    const T* Find(string_view productId) const;
+
+    // Get a product by product index, nullptr if it is not in the catalog
+    const T* Find(int productIndex) const;
+
+    // Get the number of products
+    int Size() const;
+
+private:
+    deque<T> products;                              // deque keeps addresses stable
+    vector<const T*> by_index;
+    unordered_map<string_view, const T*> by_id;     // views of the owned product identifiers
+};
+
 /**
  * Base class for a product.
  */
@@ -25,12 +114,16 @@ public:
     // Get the product identifier
     const string& GetProductId() const;
 
+    // Get the dense product index, see ProductIndex
+    int GetProductIndex() const;
+
     // Ge the product type
     ProductType GetProductType() const;
 
 private:
     string productId;
     ProductType productType;
+    int productIndex = -1;
 };
 
 enum BondIdType { CUSIP, ISIN };
@@ -69,10 +162,139 @@ private:
     date maturityDate;
 };
 
+int ProductIndex::Intern(const string& productId)
+{
+    {
+        shared_lock<shared_mutex> lock(Mutex());
+        auto it = Indices().find(productId);
+        if (it != Indices().end())
+            return it->second;
+    }
+    unique_lock<shared_mutex> lock(Mutex());
+    auto it = Indices().find(productId);
+    if (it != Indices().end())
+        return it->second;
+    int index = (int)ProductIds().size();
+    Indices()[productId] = index;
+    ProductIds().push_back(productId);
+    return index;
+}
+
+int ProductIndex::Find(const string& productId)
+{
+    shared_lock<shared_mutex> lock(Mutex());
+    auto it = Indices().find(productId);
+    return it == Indices().end() ? -1 : it->second;
+}
+
+const string& ProductIndex::GetProductId(int index)
+{
+    shared_lock<shared_mutex> lock(Mutex());
+    return ProductIds()[index];
+}
+
+int ProductIndex::Size()
+{
+    shared_lock<shared_mutex> lock(Mutex());
+    return (int)ProductIds().size();
+}
+
+unordered_map<string, int>& ProductIndex::Indices()
+{
+    static unordered_map<string, int> indices;
+    return indices;
+}
+
+deque<string>& ProductIndex::ProductIds()
+{
+    static deque<string> product_ids;     // deque keeps references stable as products are added
+    return product_ids;
+}
+
+shared_mutex& ProductIndex::Mutex()
+{
+    static shared_mutex mutex;
+    return mutex;
+}
+
+
+template<typename V>
+V& ProductTable<V>::operator[](int index)
+{
+    if (index >= (int)slots.size())
+    {
+        slots.resize(index + 1);
+        stored.resize(index + 1, false);
+    }
+    stored[index] = true;
+    return slots[index];
+}
+
+template<typename V>
+V& ProductTable<V>::operator[](const string& productId)
+{
+    return (*this)[ProductIndex::Intern(productId)];
+}
+
+template<typename V>
+V* ProductTable<V>::Find(int index)
+{
+    if (index < 0 || index >= (int)slots.size() || !stored[index])
+        return nullptr;
+    return &slots[index];
+}
+
+template<typename V>
+int ProductTable<V>::Size() const
+{
+    return (int)slots.size();
+}
+
+
+template<typename T>
+const T& ProductCatalog<T>::Add(const T& product)
+{
+    const T* existing = Find(string_view(product.GetProductId()));
+    if (existing != nullptr)
+        return *existing;
+
+    products.push_back(product);
+    const T* owned = &products.back();
+    int index = owned->GetProductIndex();
+    if (index >= (int)by_index.size())
+        by_index.resize(index + 1, nullptr);
+    by_index[index] = owned;
+    by_id[string_view(owned->GetProductId())] = owned;
+    return *owned;
+}
+
+template<typename T>
+const T* ProductCatalog<T>::Find(string_view productId) const
+{
+    auto it = by_id.find(productId);
+    return it == by_id.end() ? nullptr : it->second;
+}
+
+template<typename T>
+const T* ProductCatalog<T>::Find(int productIndex) const
+{
+    if (productIndex < 0 || productIndex >= (int)by_index.size())
+        return nullptr;
+    return by_index[productIndex];
+}
+
+template<typename T>
+int ProductCatalog<T>::Size() const
+{
+    return (int)products.size();
+}
+
+
 Product::Product(string _productId, ProductType _productType)
 {
     productId = _productId;
     productType = _productType;
+    productIndex = ProductIndex::Intern(productId);
 }
 
 const string& Product::GetProductId() const
@@ -80,6 +302,11 @@ const string& Product::GetProductId() const
     return productId;
 }
 
+int Product::GetProductIndex() const
+{
+    return productIndex;
+}
+
 ProductType Product::GetProductType() const
 {
     return productType;
@@ -6,6 +6,7 @@
 #include <string>
 #include <vector>
 #include "SOA.hpp"
+#include "Products.hpp"
 #include "PositionService.hpp"
 #include "DataGenerator.hpp"
 
@@ -17,7 +18,7 @@ template<typename T>
 class PV01
 {
 public:
-    // ctor
+    // ctor, the product is referenced and must outlive the PV01
     PV01() = default;
     PV01(const T& _product, double _pv01, double _quantity);
 
@@ -34,7 +35,7 @@ public:
     void UpdateQuantity(double _quantity);
 
 private:
-    T product;
+    const T* product = nullptr;
     double pv01;
     double quantity;
 };
@@ -67,14 +68,14 @@ private:
 
 /**
  * Risk Service to vend out risk for a particular security and across a risk bucketed sector.
- * Keyed on product identifier.
- * Type T is the product type.
+ * Keyed on product identifier, stored by product index.
+ * Type T is the product type, Chain the compile-time listener chain.
  */
-template<typename T>
-class RiskService : public Service<string, PV01 <T> >
+template<typename T, typename Chain = ListenerChain<PV01<T> > >
+class RiskService : public Service<string, PV01 <T>, Chain>
 {
 private:
-    map<string, PV01 <T> > pv01s;
+    ProductTable<PV01<T> > pv01s;
 
 public:
     // ctor
@@ -83,12 +84,18 @@ public:
     // Get data on our service given a key
     PV01 <T>& GetData(string key);
 
+    // Get data on our service given a product index
+    PV01 <T>& GetData(int productIndex);
+
     // The callback that a Connector should invoke for any new or updated data
     void OnMessage(PV01<T>& data);
 
     // Add a position that the service will risk
     void AddPosition(Position<T>& position);
 
+    // Add a block of positions that the service will risk
+    void AddPositionBatch(vector<Position<T> >& positions);
+
     // Get the bucketed risk for the bucket sector
     const PV01<BucketedSector<T>>& GetBucketedRisk(const BucketedSector<T>& _sector) const;
 
@@ -97,7 +104,7 @@ public:
 
 template<typename T>
 PV01<T>::PV01(const T& _product, double _pv01, double _quantity) :
-    product(_product)
+    product(&_product)
 {
     pv01 = _pv01;
     quantity = _quantity;
@@ -106,7 +113,7 @@ PV01<T>::PV01(const T& _product, double _pv01, double _quantity) :
 template <typename T>
 const T& PV01<T>::GetProduct() const
 {
-    return product;
+    return *product;
 }
 
 template <typename T>
@@ -148,42 +155,61 @@ const string& BucketedSector<T>::GetName() const
 }
 
 
-template <typename T>
-PV01<T>& RiskService<T>::GetData(string key)
+template <typename T, typename Chain>
+PV01<T>& RiskService<T, Chain>::GetData(string key)
 {
-    return pv01s.find(key)->second;
+    return pv01s[key];
 }
 
-template <typename T>
-void RiskService<T>::OnMessage(PV01<T>& data)
+template <typename T, typename Chain>
+PV01<T>& RiskService<T, Chain>::GetData(int productIndex)
 {
-    pv01s[data.GetProduct().GetProductId()] = data;
+    return pv01s[productIndex];
 }
 
-template <typename T>
-void RiskService<T>::AddPosition(Position<T>& position)
+template <typename T, typename Chain>
+void RiskService<T, Chain>::OnMessage(PV01<T>& data)
 {
-    T product = position.GetProduct();
-    string product_id = product.GetProductId();
+    pv01s[data.GetProduct().GetProductIndex()] = data;
+}
+
+template <typename T, typename Chain>
+void RiskService<T, Chain>::AddPosition(Position<T>& position)
+{
+    const T& product = position.GetProduct();
     double quantity = position.GetAggregatePosition();
-    double pv = g_PV01s[product_id];
+    double pv = g_PV01s[product.GetProductId()];
 
     PV01<T> new_pv01(product, pv, quantity);
-    pv01s[product_id] = new_pv01;
-    Service<string, PV01 <T> >::Notify(new_pv01);
+    pv01s[product.GetProductIndex()] = new_pv01;
+    Service<string, PV01 <T>, Chain>::Notify(new_pv01);
 }
 
-template<typename T>
-const PV01<BucketedSector<T>>& RiskService<T>::GetBucketedRisk(const BucketedSector<T>& sector) const
+template <typename T, typename Chain>
+void RiskService<T, Chain>::AddPositionBatch(vector<Position<T> >& positions)
+{
+    vector<PV01<T> > updates;
+    updates.reserve(positions.size());
+    for (auto& position : positions)
+    {
+        const T& product = position.GetProduct();
+        PV01<T> new_pv01(product, g_PV01s[product.GetProductId()], position.GetAggregatePosition());
+        pv01s[product.GetProductIndex()] = new_pv01;
+        updates.push_back(new_pv01);
+    }
+    Service<string, PV01 <T>, Chain>::NotifyBatch(updates);
+}
+
+template<typename T, typename Chain>
+const PV01<BucketedSector<T>>& RiskService<T, Chain>::GetBucketedRisk(const BucketedSector<T>& sector) const
 {
-    BucketedSector<T> product = sector;
     double pv01 = 0;
     for (auto& p : sector.GetProducts())
     {
         string id = p.GetProductId();
         pv01 += (pv01s[id].GetPV01() * pv01s[id].GetQuantity());
     }
-    return PV01<BucketedSector<T>>(product, pv01, 1);
+    return PV01<BucketedSector<T>>(sector, pv01, 1);
 }
 
 #endif
@@ -5,9 +5,260 @@
 
 #include <vector>
 #include <memory>
+#include <tuple>
+#include <utility>
+#include <string>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <typeinfo>
+#include <cassert>
+#include <cstdlib>
+#ifdef __GNUG__
+#include <cxxabi.h>
+#endif
 
 using namespace std;
 
+
+/**
+ * Latency histogram with log-linear buckets (HDR style): values below 32 get exact buckets,
+ * larger values get 16 buckets per power of two, so every bucket is within ~6% of its value.
+ * Values are nanoseconds. Any thread may record, the counters are relaxed atomics.
+ */
+class LatencyHistogram
+{
+public:
+    // ctor
+    LatencyHistogram();
+
+    // Record a value
+    void Record(long long value);
+
+    // Get the number of recorded values
+    long long GetCount() const;
+
+    // Get the largest recorded value
+    long long GetMax() const;
+
+    // Get the value at a percentile in [0, 100], reported as the upper bound of its bucket
+    long long GetPercentile(double percentile) const;
+
+private:
+    static const int bucket_count = 32 + 59 * 16;
+    atomic<long long> counts[bucket_count];
+    atomic<long long> count;
+    atomic<long long> max;
+
+    // Get the bucket of a value
+    static int Bucket(long long value);
+
+    // Get the largest value that falls in a bucket
+    static long long BucketUpperBound(int bucket);
+};
+
+
+/**
+ * Process-wide registry of named latency histograms.
+ * Prints a report of every histogram at shutdown, or on demand with Report().
+ */
+class LatencyRegistry
+{
+public:
+    ~LatencyRegistry();
+
+    // Get the registry
+    static LatencyRegistry& Instance();
+
+    // Get the histogram of a name, creating it if needed. The reference stays valid.
+    LatencyHistogram& Get(const string& name);
+
+    // Print count, p50, p99, p99.9 and max of every histogram
+    void Report(ostream& out);
+
+private:
+    map<string, unique_ptr<LatencyHistogram> > histograms;
+    mutex registry_mutex;
+};
+
+
+/**
+ * Records the time between its construction and destruction into a histogram.
+ */
+class LatencyTimer
+{
+public:
+    LatencyTimer(LatencyHistogram& _histogram) :
+        histogram(_histogram), start(chrono::steady_clock::now()) {}
+
+    ~LatencyTimer()
+    {
+        histogram.Record(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+    }
+
+private:
+    LatencyHistogram& histogram;
+    chrono::steady_clock::time_point start;
+};
+
+// Get the demangled name of a type with its template arguments, e.g. "PricingService<Bond>".
+// Arguments nested more than two levels deep are shortened to "<...>".
+string TypeName(const type_info& type);
+
+
+LatencyHistogram::LatencyHistogram() : count(0), max(0)
+{
+    for (auto& e : counts)
+        e.store(0, memory_order_relaxed);
+}
+
+void LatencyHistogram::Record(long long value)
+{
+    if (value < 0)
+        value = 0;
+    counts[Bucket(value)].fetch_add(1, memory_order_relaxed);
+    count.fetch_add(1, memory_order_relaxed);
+    long long seen_max = max.load(memory_order_relaxed);
+    while (value > seen_max && !max.compare_exchange_weak(seen_max, value, memory_order_relaxed))
+        ;
+}
+
+long long LatencyHistogram::GetCount() const
+{
+    return count.load(memory_order_relaxed);
+}
+
+long long LatencyHistogram::GetMax() const
+{
+    return max.load(memory_order_relaxed);
+}
+
+long long LatencyHistogram::GetPercentile(double percentile) const
+{
+    long long total = GetCount();
+    long long largest = GetMax();
+    if (total == 0)
+        return 0;
+    long long rank = (long long)(percentile / 100.0 * total + 0.999999);
+    if (rank < 1)
+        rank = 1;
+    long long seen = 0;
+    for (int i = 0; i < bucket_count; ++i)
+    {
+        seen += counts[i].load(memory_order_relaxed);
+        if (seen >= rank)
+            return BucketUpperBound(i) < largest ? BucketUpperBound(i) : largest;
+    }
+    return largest;
+}
+
+int LatencyHistogram::Bucket(long long value)
+{
+    if (value < 32)
+        return (int)value;
+    int msb = 63;
+    while (!(value >> msb))
+        --msb;
+    int shift = msb - 4;
+    return 32 + (shift - 1) * 16 + (int)((value >> shift) - 16);
+}
+
+long long LatencyHistogram::BucketUpperBound(int bucket)
+{
+    if (bucket < 32)
+        return bucket;
+    int shift = (bucket - 32) / 16 + 1;
+    long long mantissa = (bucket - 32) % 16 + 16;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+
+LatencyRegistry::~LatencyRegistry()
+{
+    Report(cout);
+}
+
+LatencyRegistry& LatencyRegistry::Instance()
+{
+    static LatencyRegistry registry;
+    return registry;
+}
+
+LatencyHistogram& LatencyRegistry::Get(const string& name)
+{
+    lock_guard<mutex> lock(registry_mutex);
+    unique_ptr<LatencyHistogram>& histogram = histograms[name];
+    if (!histogram)
+        histogram.reset(new LatencyHistogram());
+    return *histogram;
+}
+
+void LatencyRegistry::Report(ostream& out)
+{
+    lock_guard<mutex> lock(registry_mutex);
+    if (histograms.empty())
+        return;
+    out << left << setw(64) << "Latency (ns)" << right << setw(12) << "count" << setw(12) << "p50"
+        << setw(12) << "p99" << setw(12) << "p99.9" << setw(12) << "max" << "\n";
+    for (auto& e : histograms)
+    {
+        const LatencyHistogram& h = *e.second;
+        if (h.GetCount() == 0)
+            continue;
+        out << left << setw(64) << e.first << right << setw(12) << h.GetCount() << setw(12) << h.GetPercentile(50)
+            << setw(12) << h.GetPercentile(99) << setw(12) << h.GetPercentile(99.9) << setw(12) << h.GetMax() << "\n";
+    }
+    out << left << endl;
+}
+
+string TypeName(const type_info& type)
+{
+    string name = type.name();
+#ifdef __GNUG__
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+    if (status == 0 && demangled != nullptr)
+        name = demangled;
+    free(demangled);
+#endif
+    if (name.compare(0, 6, "class ") == 0)
+        name = name.substr(6);
+    else if (name.compare(0, 7, "struct ") == 0)
+        name = name.substr(7);
+    string shortened;
+    int depth = 0;
+    for (char c : name)
+    {
+        if (c == '<' && ++depth == 3)
+            shortened += "<...";
+        else if (c == '>' && depth-- == 3)
+            shortened += '>';
+        else if (depth < 3)
+            shortened += c;
+    }
+    return shortened;
+}
+
+
+/**
+ * Compile-time switch for latency instrumentation. Build with SOA_LATENCY_STATS defined to
+ * record OnMessage and listener durations into the LatencyRegistry; otherwise the hooks
+ * compile to nothing.
+ * SOA_LATENCY_SCOPE(name) times the rest of the enclosing scope into the histogram "name".
+ */
+#ifdef SOA_LATENCY_STATS
+#define SOA_LATENCY_JOIN2(a, b) a##b
+#define SOA_LATENCY_JOIN(a, b) SOA_LATENCY_JOIN2(a, b)
+#define SOA_LATENCY_SCOPE(name) \
+    static LatencyHistogram& SOA_LATENCY_JOIN(soa_histogram_, __LINE__) = LatencyRegistry::Instance().Get(name); \
+    LatencyTimer SOA_LATENCY_JOIN(soa_timer_, __LINE__)(SOA_LATENCY_JOIN(soa_histogram_, __LINE__))
+#else
+#define SOA_LATENCY_SCOPE(name)
+#endif
+
 /**
  * Definition of a generic base class ServiceListener to listen to add, update, and remve
  * events on a Service. This listener should be registered on a Service for the Service
@@ -27,18 +278,116 @@ public:
 
     // Listener callback to process an update event to the Service
     virtual void ProcessUpdate(V& data) = 0;
+
+    // Listener callback to process a batch of add events to the Service, in order.
+    // Override to amortize per-event work across the batch.
+    virtual void ProcessAddBatch(vector<V>& data)
+    {
+        for (auto& e : data)
+            ProcessAdd(e);
+    }
+};
+
+
+/**
+ * Compile-time listener chain for a fixed service topology.
+ * Holds the concrete listener types and calls them with qualified (non-virtual) calls,
+ * so the compiler can inline every stage of the chain into the notifying service.
+ * Type V is the event type and L... are the concrete ServiceListener<V> types, in
+ * notification order.
+ * A chain built with the default ctor must be bound before the service is notified; an
+ * unbound listener is skipped, and asserts in debug builds.
+ */
+template<typename V, typename... L>
+class ListenerChain
+{
+private:
+    tuple<L*...> chain;
+
+    template<typename X>
+    static void CallAdd(X* listener, V& data)
+    {
+        assert(listener != nullptr && "ListenerChain notified before Bind()");
+        if (listener == nullptr)
+            return;
+        SOA_LATENCY_SCOPE(TypeName(typeid(X)) + "::ProcessAdd");
+        listener->X::ProcessAdd(data);
+    }
+
+    template<typename X>
+    static void CallAddBatch(X* listener, vector<V>& data)
+    {
+        assert(listener != nullptr && "ListenerChain notified before Bind()");
+        if (listener == nullptr)
+            return;
+        SOA_LATENCY_SCOPE(TypeName(typeid(X)) + "::ProcessAddBatch");
+        listener->X::ProcessAddBatch(data);
+    }
+
+    template<size_t... I>
+    void DispatchAdd(V& data, index_sequence<I...>)
+    {
+        (CallAdd(get<I>(chain), data), ...);
+    }
+
+    template<size_t... I>
+    void DispatchAddBatch(vector<V>& data, index_sequence<I...>)
+    {
+        (CallAddBatch(get<I>(chain), data), ...);
+    }
+
+public:
+    // ctor for a chain, listeners can be bound later
+    ListenerChain() : chain(static_cast<L*>(nullptr)...) {}
+    ListenerChain(L*... _listeners) : chain(_listeners...) {}
+
+    // Bind the listeners of the chain
+    void Bind(L*... _listeners)
+    {
+        chain = tuple<L*...>(_listeners...);
+    }
+
+    // Forward an add event to every listener of the chain
+    void ProcessAdd(V& data)
+    {
+        DispatchAdd(data, index_sequence_for<L...>());
+    }
+
+    // Forward a batch of add events to every listener of the chain
+    void ProcessAddBatch(vector<V>& data)
+    {
+        DispatchAddBatch(data, index_sequence_for<L...>());
+    }
+};
+
+/**
+ * Empty listener chain, the default for services wired only through AddListener().
+ */
+template<typename V>
+class ListenerChain<V>
+{
+public:
+    void ProcessAdd(V& data) {}
+    void ProcessAddBatch(vector<V>& data) {}
 };
 
 
 /**
  * Definition of a generic base class Service.
  * Uses key generic type K and value generic type V.
+ * Chain is an optional compile-time ListenerChain<V, ...> notified ahead of the
+ * listeners registered through AddListener().
  */
-template<typename K, typename V>
+template<typename K, typename V, typename Chain = ListenerChain<V> >
 class Service
 {
 protected:
     vector<ServiceListener<V>* > listeners;
+    Chain chain;
+#ifdef SOA_LATENCY_STATS
+    vector<LatencyHistogram*> listener_latency;         // ProcessAdd histogram of each listener on this service
+    vector<LatencyHistogram*> listener_batch_latency;   // ProcessAddBatch histogram of each listener
+#endif
 
 public:
     virtual ~Service() {}
@@ -49,11 +398,23 @@ public:
     // The callback that a Connector should invoke for any new or updated data
     virtual void OnMessage(V& data) = 0;
 
+    // The callback that a Connector should invoke for a block of new or updated data, in order
+    virtual void OnMessageBatch(vector<V>& data)
+    {
+        for (auto& e : data)
+            OnMessage(e);
+    }
+
     // Add a listener to the Service for callbacks on add, remove, and update events
     // for data to the Service.
     virtual void AddListener(ServiceListener<V>* listener) 
     {
         listeners.push_back(listener);
+#ifdef SOA_LATENCY_STATS
+        string name = TypeName(typeid(*this)) + " -> " + TypeName(typeid(*listener));
+        listener_latency.push_back(&LatencyRegistry::Instance().Get(name + "::ProcessAdd"));
+        listener_batch_latency.push_back(&LatencyRegistry::Instance().Get(name + "::ProcessAddBatch"));
+#endif
     }
 
     // Get all listeners on the Service.
@@ -62,11 +423,43 @@ public:
         return listeners;
     }
 
+    // Get the compile-time listener chain on the Service.
+    Chain& GetListenerChain()
+    {
+        return chain;
+    }
+
     // Notify all listeners of the update.
     virtual void Notify(V& data) 
     {
+        chain.ProcessAdd(data);
+#ifdef SOA_LATENCY_STATS
+        for (size_t i = 0; i < listeners.size(); ++i)
+        {
+            LatencyTimer timer(*listener_latency[i]);
+            listeners[i]->ProcessAdd(data);
+        }
+#else
         for (auto& e : listeners) 
             e->ProcessAdd(data);
+#endif
+    }
+
+    // Notify all listeners of a batch of updates.
+    // Each listener sees the whole batch, in order, before the next listener is called.
+    virtual void NotifyBatch(vector<V>& data)
+    {
+        chain.ProcessAddBatch(data);
+#ifdef SOA_LATENCY_STATS
+        for (size_t i = 0; i < listeners.size(); ++i)
+        {
+            LatencyTimer timer(*listener_batch_latency[i]);
+            listeners[i]->ProcessAddBatch(data);
+        }
+#else
+        for (auto& e : listeners)
+            e->ProcessAddBatch(data);
+#endif
     }
 };
 
@@ -0,0 +1,195 @@
+
+#ifndef SEQ_LOCK_HPP
+#define SEQ_LOCK_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+using namespace std;
+
+
+/**
+ * A value published by one writer thread and read by any number of threads without locks.
+ * The writer makes the sequence number odd, stores the value and makes it even again; a
+ * reader copies the value and retries if the sequence number was odd or moved meanwhile.
+ * The value is kept as relaxed atomic words so the copies are not data races. Each SeqLock
+ * takes whole cache lines, so writing one does not slow down readers of its neighbours.
+ * Type V must be trivially copyable and default constructible.
+ */
+template<typename V>
+class alignas(64) SeqLock
+{
+    static_assert(is_trivially_copyable<V>::value, "SeqLock values must be trivially copyable");
+
+public:
+    // ctor, the value starts out as V()
+    SeqLock();
+
+    SeqLock(const SeqLock&) = delete;
+    SeqLock& operator=(const SeqLock&) = delete;
+
+    // Publish a value, only one thread may store
+    void Store(const V& value);
+
+    // Get the last published value
+    V Load() const;
+
+    // Get the last published value and its version, from the same read
+    V Load(uint64_t& version) const;
+
+    // Get the number of values published so far
+    uint64_t GetVersion() const;
+
+private:
+    static const size_t word_count = (sizeof(V) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    atomic<uint64_t> sequence;
+    atomic<uint64_t> words[word_count];
+};
+
+
+/**
+ * One SeqLock per product index, for values other threads read while the writer updates them.
+ * Slots are allocated in blocks the first time an index is stored and never move, so readers
+ * index the table without locks while the writer adds products.
+ * Type V is the value type, as for SeqLock.
+ */
+template<typename V>
+class SeqLockTable
+{
+public:
+    // ctor for an empty table
+    SeqLockTable();
+    ~SeqLockTable();
+
+    SeqLockTable(const SeqLockTable&) = delete;
+    SeqLockTable& operator=(const SeqLockTable&) = delete;
+
+    // Publish the value of an index, only one thread may store. Indices past capacity are ignored.
+    void Store(int index, const V& value);
+
+    // Get the value of an index, false if none was ever stored
+    bool Load(int index, V& value) const;
+
+    // Get the number of indices the table can hold
+    static constexpr int GetCapacity() { return (int)(block_count * block_size); }
+
+private:
+    static const size_t block_size = 64;
+    static const size_t block_count = 1024;
+
+    atomic<SeqLock<V>*> blocks[block_count];
+};
+
+
+template<typename V>
+SeqLock<V>::SeqLock() : sequence(0)
+{
+    uint64_t buffer[word_count] = {};
+    V value = V();
+    memcpy(buffer, &value, sizeof(V));
+    for (size_t i = 0; i < word_count; ++i)
+        words[i].store(buffer[i], memory_order_relaxed);
+}
+
+template<typename V>
+void SeqLock<V>::Store(const V& value)
+{
+    uint64_t buffer[word_count] = {};
+    memcpy(buffer, &value, sizeof(V));
+    uint64_t seq = sequence.load(memory_order_relaxed);
+    sequence.store(seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);     // readers see the odd sequence before any new word
+    for (size_t i = 0; i < word_count; ++i)
+        words[i].store(buffer[i], memory_order_relaxed);
+    sequence.store(seq + 2, memory_order_release);
+}
+
+template<typename V>
+V SeqLock<V>::Load() const
+{
+    uint64_t version;
+    return Load(version);
+}
+
+template<typename V>
+V SeqLock<V>::Load(uint64_t& version) const
+{
+    uint64_t buffer[word_count];
+    for (;;)
+    {
+        uint64_t before = sequence.load(memory_order_acquire);
+        if (before & 1)
+        {
+            this_thread::yield();
+            continue;
+        }
+        for (size_t i = 0; i < word_count; ++i)
+            buffer[i] = words[i].load(memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);     // the words are read before the sequence is checked
+        if (sequence.load(memory_order_relaxed) == before)
+        {
+            version = before / 2;
+            break;
+        }
+    }
+    V value;
+    memcpy(&value, buffer, sizeof(V));
+    return value;
+}
+
+template<typename V>
+uint64_t SeqLock<V>::GetVersion() const
+{
+    return sequence.load(memory_order_acquire) / 2;
+}
+
+
+template<typename V>
+SeqLockTable<V>::SeqLockTable()
+{
+    for (auto& e : blocks)
+        e.store(nullptr, memory_order_relaxed);
+}
+
+template<typename V>
+SeqLockTable<V>::~SeqLockTable()
+{
+    for (auto& e : blocks)
+        delete[] e.load(memory_order_relaxed);
+}
+
+template<typename V>
+void SeqLockTable<V>::Store(int index, const V& value)
+{
+    if (index < 0 || index >= GetCapacity())
+        return;
+    atomic<SeqLock<V>*>& block = blocks[index / block_size];
+    SeqLock<V>* slots = block.load(memory_order_relaxed);
+    if (slots == nullptr)
+    {
+        slots = new SeqLock<V>[block_size];
+        block.store(slots, memory_order_release);
+    }
+    slots[index % block_size].Store(value);
+}
+
+template<typename V>
+bool SeqLockTable<V>::Load(int index, V& value) const
+{
+    if (index < 0 || index >= GetCapacity())
+        return false;
+    SeqLock<V>* slots = blocks[index / block_size].load(memory_order_acquire);
+    if (slots == nullptr)
+        return false;
+    const SeqLock<V>& slot = slots[index % block_size];
+    if (slot.GetVersion() == 0)
+        return false;
+    value = slot.Load();
+    return true;
+}
+
+#endif
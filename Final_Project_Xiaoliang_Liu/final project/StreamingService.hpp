@@ -5,6 +5,7 @@
 #include <string>
 #include <map>
 #include "SOA.hpp"
+#include "Products.hpp"
 #include "MarketDataService.hpp"
 
  /**
@@ -15,13 +16,13 @@ class PriceStreamOrder
 public:
     // ctor
     PriceStreamOrder() = default;
-    PriceStreamOrder(double _price, long _visibleQuantity, long _hiddenQuantity, PricingSide _side);
+    PriceStreamOrder(TickPrice _price, long _visibleQuantity, long _hiddenQuantity, PricingSide _side);
 
     // The side on this order
     PricingSide GetSide() const;
 
     // Get the price on this order
-    double GetPrice() const;
+    TickPrice GetPrice() const;
 
     // Get the visible quantity on this order
     long GetVisibleQuantity() const;
@@ -30,7 +31,7 @@ public:
     long GetHiddenQuantity() const;
 
 private:
-    double price;
+    TickPrice price;
     long visibleQuantity;
     long hiddenQuantity;
     PricingSide side;
@@ -45,7 +46,7 @@ template<typename T>
 class PriceStream
 {
 public:
-    // ctor
+    // ctor, the product is referenced and must outlive the stream
     PriceStream() = default;
     PriceStream(const T& _product, const PriceStreamOrder& _bidOrder, const PriceStreamOrder& _offerOrder);
 
@@ -59,7 +60,7 @@ public:
     const PriceStreamOrder& GetOfferOrder() const;
 
 private:
-    T product;
+    const T* product = nullptr;
     PriceStreamOrder bidOrder;
     PriceStreamOrder offerOrder;
 };
@@ -67,28 +68,34 @@ private:
 
 /**
  * Streaming service to publish two-way prices.
- * Keyed on product identifier.
- * Type T is the product type.
+ * Keyed on product identifier, stored by product index.
+ * Type T is the product type, Chain the compile-time listener chain.
  */
-template<typename T>
-class StreamingService : public Service<string, PriceStream <T> >
+template<typename T, typename Chain = ListenerChain<PriceStream<T> > >
+class StreamingService : public Service<string, PriceStream <T>, Chain>
 {
 private:
-    map<string, PriceStream<T>> pricestreams;
+    ProductTable<PriceStream<T> > pricestreams;
 
 public:
     // Get data on our service given a key
     PriceStream<T>& GetData(string key);
 
+    // Get data on our service given a product index
+    PriceStream<T>& GetData(int productIndex);
+
     // The callback that a Connector should invoke for any new or updated data
     void OnMessage(PriceStream<T>& data);
 
     // Publish two-way prices
     void PublishPrice(PriceStream<T>& priceStream); 
+
+    // Publish a block of two-way prices
+    void PublishPriceBatch(vector<PriceStream<T> >& priceStreams);
 };
 
 
-PriceStreamOrder::PriceStreamOrder(double _price, long _visibleQuantity, long _hiddenQuantity, PricingSide _side)
+PriceStreamOrder::PriceStreamOrder(TickPrice _price, long _visibleQuantity, long _hiddenQuantity, PricingSide _side)
 {
     price = _price;
     visibleQuantity = _visibleQuantity;
@@ -101,7 +108,7 @@ PricingSide PriceStreamOrder::GetSide() const
     return side;
 }
 
-double PriceStreamOrder::GetPrice() const
+TickPrice PriceStreamOrder::GetPrice() const
 {
     return price;
 }
@@ -119,14 +126,14 @@ long PriceStreamOrder::GetHiddenQuantity() const
 
 template<typename T>
 PriceStream<T>::PriceStream(const T& _product, const PriceStreamOrder& _bidOrder, const PriceStreamOrder& _offerOrder) :
-    product(_product), bidOrder(_bidOrder), offerOrder(_offerOrder)
+    product(&_product), bidOrder(_bidOrder), offerOrder(_offerOrder)
 {
 }
 
 template<typename T>
 const T& PriceStream<T>::GetProduct() const
 {
-    return product;
+    return *product;
 }
 
 template<typename T>
@@ -142,22 +149,34 @@ const PriceStreamOrder& PriceStream<T>::GetOfferOrder() const
 }
 
 
-template <typename T>
-PriceStream<T>& StreamingService<T>::GetData(string key)
+template <typename T, typename Chain>
+PriceStream<T>& StreamingService<T, Chain>::GetData(string key)
 {
     return pricestreams[key];
 }
 
-template <typename T>
-void StreamingService<T>::OnMessage(PriceStream<T>& data)
+template <typename T, typename Chain>
+PriceStream<T>& StreamingService<T, Chain>::GetData(int productIndex)
+{
+    return pricestreams[productIndex];
+}
+
+template <typename T, typename Chain>
+void StreamingService<T, Chain>::OnMessage(PriceStream<T>& data)
+{
+    pricestreams[data.GetProduct().GetProductIndex()] = data;
+}
+
+template <typename T, typename Chain>
+void StreamingService<T, Chain>::PublishPrice(PriceStream<T>& priceStream)
 {
-    pricestreams[data.GetProduct().GetProductId()] = data;
+    Service<string, PriceStream<T>, Chain>::Notify(priceStream);
 }
 
-template <typename T>
-void StreamingService<T>::PublishPrice(PriceStream<T>& priceStream)
+template <typename T, typename Chain>
+void StreamingService<T, Chain>::PublishPriceBatch(vector<PriceStream<T> >& priceStreams)
 {
-    Service<string, PriceStream<T> >::Notify(priceStream);
+    Service<string, PriceStream<T>, Chain>::NotifyBatch(priceStreams);
 }
 
 #endif
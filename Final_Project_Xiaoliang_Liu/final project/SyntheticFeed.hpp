@@ -0,0 +1,73 @@
+
+#ifndef SYNTHETIC_FEED_HPP
+#define SYNTHETIC_FEED_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DataGenerator.hpp"
+
+using namespace std;
+
+// Settings of a feed synthesized in memory
+struct SyntheticFeedOptions
+{
+    uint64_t seed = 1;
+    size_t product_count = 7;               // the first products of g_product_Ids
+    uint64_t count_per_product = 1000000;   // 0 for an endless feed
+    double rate = 0;                        // events per second, 0 for as fast as the pipeline takes them
+    double duration = 0;                    // seconds after which the feed ends, 0 for no limit
+};
+
+// Run a synthetic feed of events of type X.
+// make(SplitMix64& rng, size_t product, uint64_t index, uint64_t event, X& out) builds the event
+// number event, the index-th of its product, and returns false to skip it; deliver(vector<X>& batch)
+// hands a batch of at most batch_size events on. Returns the number of events made.
+//
+// The events are drawn like the lines of the files DataGenerator.hpp writes, from a generator
+// seeded by the seed and kind, so a feed repeats exactly. The products take turns rather than
+// come one after the other, so an endless feed covers all of them. With a rate, a batch holds
+// at most a millisecond's worth of events and is delivered when the schedule reaches it.
+template<typename X, typename Make, typename Deliver>
+uint64_t RunSyntheticFeed(const SyntheticFeedOptions& options, const string& kind, size_t batch_size, Make make, Deliver deliver)
+{
+    size_t products = min(options.product_count, g_product_Ids.size());
+    if (products == 0)
+        return 0;
+    uint64_t total = options.count_per_product == 0 ? UINT64_MAX : options.count_per_product * products;
+    size_t batch_limit = max(batch_size, (size_t)1);
+    if (options.rate > 0)
+        batch_limit = min(batch_limit, max((size_t)(options.rate / 1000), (size_t)1));
+
+    SplitMix64 rng(ChunkSeed(options.seed, "synthetic " + kind, 0, 0));
+    vector<X> batch;
+    batch.reserve(batch_limit);
+    auto start = chrono::steady_clock::now();
+    uint64_t event = 0;
+    while (event < total)
+    {
+        uint64_t first = event;
+        batch.resize(batch_limit);
+        size_t count = 0;
+        for (; count < batch_limit && event < total; ++event)
+        {
+            if (make(rng, (size_t)(event % products), event / products, event, batch[count]))
+                ++count;
+        }
+        batch.resize(count);
+
+        if (options.rate > 0)
+            this_thread::sleep_until(start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(first / options.rate)));
+        if (!batch.empty())
+            deliver(batch);
+        if (options.duration > 0 && chrono::steady_clock::now() - start >= chrono::duration<double>(options.duration))
+            break;
+    }
+    return event;
+}
+
+#endif
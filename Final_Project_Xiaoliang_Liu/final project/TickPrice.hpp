@@ -0,0 +1,159 @@
+
+#ifndef TICK_PRICE_HPP
+#define TICK_PRICE_HPP
+
+#include <iostream>
+#include <functional>
+#include <cmath>
+#include <string>
+#include <string_view>
+#include <stdexcept>
+
+using namespace std;
+
+// Number of ticks in one point of price, a tick is 1/256 of a point
+const long long TICKS_PER_POINT = 256;
+
+/**
+ * Fixed-point bond price counted in ticks of 1/256 of a point, the finest increment of the
+ * fractional notation. Comparisons, differences and hashing are exact integer operations;
+ * a price is only turned into a double for output.
+ */
+class TickPrice
+{
+public:
+    // ctor for a price of a number of ticks
+    constexpr TickPrice() : ticks(0) {}
+    constexpr explicit TickPrice(long long _ticks) : ticks(_ticks) {}
+
+    // Get the price nearest to a numerical price
+    static TickPrice FromDouble(double price);
+
+    // Get the number of ticks
+    constexpr long long GetTicks() const { return ticks; }
+
+    // Get the numerical price, exact in a double
+    double ToDouble() const;
+
+    constexpr TickPrice operator+(TickPrice other) const { return TickPrice(ticks + other.ticks); }
+    constexpr TickPrice operator-(TickPrice other) const { return TickPrice(ticks - other.ticks); }
+    TickPrice& operator+=(TickPrice other) { ticks += other.ticks; return *this; }
+    TickPrice& operator-=(TickPrice other) { ticks -= other.ticks; return *this; }
+
+    constexpr bool operator==(TickPrice other) const { return ticks == other.ticks; }
+    constexpr bool operator!=(TickPrice other) const { return ticks != other.ticks; }
+    constexpr bool operator<(TickPrice other) const { return ticks < other.ticks; }
+    constexpr bool operator<=(TickPrice other) const { return ticks <= other.ticks; }
+    constexpr bool operator>(TickPrice other) const { return ticks > other.ticks; }
+    constexpr bool operator>=(TickPrice other) const { return ticks >= other.ticks; }
+
+private:
+    long long ticks;
+};
+
+// Print the numerical price, formatted like a double
+ostream& operator<<(ostream& out, TickPrice price);
+
+
+namespace std
+{
+    template<>
+    struct hash<TickPrice>
+    {
+        size_t operator()(TickPrice price) const
+        {
+            return hash<long long>()(price.GetTicks());
+        }
+    };
+}
+
+
+TickPrice TickPrice::FromDouble(double price)
+{
+    return TickPrice(llround(price * TICKS_PER_POINT));
+}
+
+double TickPrice::ToDouble() const
+{
+    return (double)ticks / TICKS_PER_POINT;
+}
+
+ostream& operator<<(ostream& out, TickPrice price)
+{
+    return out << price.ToDouble();
+}
+
+
+// Lookup tables for the fractional notation "99-16+": whole points, '-', 32nds as two digits, 256ths
+struct FractionalTables
+{
+    signed char digit[256];             // value of a decimal digit character, -1 otherwise
+    signed char eighths[256];           // 256ths of a '0'-'7' or '+' (4) character, -1 otherwise
+    short thirty_seconds[100];          // ticks of a two-digit 32nds value, -1 from 32 up
+};
+
+constexpr FractionalTables MakeFractionalTables()
+{
+    FractionalTables tables{};
+    for (int i = 0; i < 256; ++i)
+    {
+        tables.digit[i] = -1;
+        tables.eighths[i] = -1;
+    }
+    for (int i = 0; i < 10; ++i)
+        tables.digit['0' + i] = (signed char)i;
+    for (int i = 0; i < 8; ++i)
+        tables.eighths['0' + i] = (signed char)i;
+    tables.eighths['+'] = 4;
+    for (int i = 0; i < 100; ++i)
+        tables.thirty_seconds[i] = (short)(i < 32 ? i * 8 : -1);
+    return tables;
+}
+
+constexpr FractionalTables g_fractional_tables = MakeFractionalTables();
+
+// Report a price that is not in the fractional notation
+[[noreturn]] void ThrowBadFractionalPrice(string_view frac_price)
+{
+    throw invalid_argument("Bad fractional price: " + string(frac_price));
+}
+
+// Convert the fractional bond price to an exact number of 1/256 ticks
+inline long long FractionalToTicks(string_view frac_price)
+{
+    const FractionalTables& tables = g_fractional_tables;
+    const unsigned char* p = (const unsigned char*)frac_price.data();
+    size_t n = frac_price.size();
+    if (n < 5 || p[n - 4] != '-')
+        ThrowBadFractionalPrice(frac_price);
+
+    long long points = 0;
+    for (size_t i = 0; i < n - 4; ++i)
+    {
+        int d = tables.digit[p[i]];
+        if (d < 0)
+            ThrowBadFractionalPrice(frac_price);
+        points = points * 10 + d;
+    }
+    int d1 = tables.digit[p[n - 3]];
+    int d2 = tables.digit[p[n - 2]];
+    int eighths = tables.eighths[p[n - 1]];
+    if ((d1 | d2 | eighths) < 0 || tables.thirty_seconds[d1 * 10 + d2] < 0)
+        ThrowBadFractionalPrice(frac_price);
+    return points * TICKS_PER_POINT + tables.thirty_seconds[d1 * 10 + d2] + eighths;
+}
+
+// Convert count fractional bond prices to ticks in one pass
+void FractionalToTicks(const string_view* frac_prices, size_t count, long long* ticks)
+{
+    for (size_t i = 0; i < count; ++i)
+        ticks[i] = FractionalToTicks(frac_prices[i]);
+}
+
+// Convert the fractional bond price to a numerical price
+double FractionalToPrice(string_view frac_price)
+{
+    return TickPrice(FractionalToTicks(frac_price)).ToDouble();
+}
+
+#endif
@@ -0,0 +1,566 @@
+
+#ifndef TICK_STORE_HPP
+#define TICK_STORE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "MappedFile.hpp"
+
+using namespace std;
+
+/*
+* Binary store of order book history, written as the books arrive and read back in place.
+*
+*   TickStoreHeader
+*   block ...                           encoded snapshots of one product
+*   TickStoreIndexHeader                at header.index_offset, written when the store is closed
+*   TickStoreProduct[product_count]     product id and its run of blocks
+*   TickStoreBlock[block_count]         grouped by product, in sequence order within a product
+*
+* Every snapshot holds TICK_STORE_DEPTH levels a side and a sequence number counting all the
+* snapshots of the store. Within a block each snapshot is encoded against the previous one of
+* the same product: the sequence gap, the level counts, then the change of every price and
+* quantity as a zigzag varint. The first snapshot of a block is encoded against zeros, so a
+* reader can start at any block, and the index finds the block of a product and sequence number
+* by binary search. Integers are stored little-endian.
+*/
+
+// Levels a side kept by a snapshot, deeper levels are dropped
+const uint32_t TICK_STORE_DEPTH = 5;
+
+const char TICK_STORE_MAGIC[8] = { 'S', 'O', 'A', 'T', 'I', 'C', 'K', '\0' };
+const uint32_t TICK_STORE_VERSION = 1;
+
+struct TickStoreHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t depth;                 // TICK_STORE_DEPTH
+    uint32_t block_records;         // snapshots per full block
+    uint32_t reserved;
+    uint64_t index_offset;          // 0 until the store is closed
+};
+
+struct TickStoreIndexHeader
+{
+    uint32_t product_count;
+    uint32_t block_count;
+};
+
+struct TickStoreProduct
+{
+    char product_id[24];            // NUL-padded
+    uint32_t first_block;
+    uint32_t block_count;
+    uint64_t snapshot_count;
+};
+
+struct TickStoreBlock
+{
+    uint64_t offset;                // file offset of the encoded snapshots
+    uint64_t first_sequence;
+    uint64_t last_sequence;
+    uint32_t product;
+    uint32_t snapshot_count;
+    uint32_t bytes;
+    uint32_t reserved;
+};
+
+// One order book in the store, prices in 1/256 ticks
+struct TickSnapshot
+{
+    uint64_t sequence;
+    uint32_t product;               // store product number
+    uint32_t bid_levels;
+    uint32_t offer_levels;
+    int64_t bid_ticks[TICK_STORE_DEPTH];
+    int64_t bid_quantities[TICK_STORE_DEPTH];
+    int64_t offer_ticks[TICK_STORE_DEPTH];
+    int64_t offer_quantities[TICK_STORE_DEPTH];
+};
+
+
+/**
+ * Appends order book snapshots to a tick store.
+ * Each product fills its own block in memory, which is written out once it holds block_records
+ * snapshots. Close() writes the remaining blocks and the index; a store that was never closed
+ * has no index and can not be read.
+ */
+class TickStoreWriter
+{
+public:
+    // ctor, creates the file; check IsOpen() for success
+    TickStoreWriter(const string& _file_name, uint32_t _block_records = 256);
+    ~TickStoreWriter();
+
+    TickStoreWriter(const TickStoreWriter&) = delete;
+    TickStoreWriter& operator=(const TickStoreWriter&) = delete;
+
+    // Whether the file could be created and no write has failed
+    bool IsOpen() const;
+
+    // Get the store number of a product id, adding the product on first use
+    uint32_t AddProduct(string_view product_id);
+
+    // Append a snapshot of the product it names, returns its sequence number
+    uint64_t Append(const TickSnapshot& snapshot);
+
+    // Get the number of snapshots appended
+    uint64_t GetSnapshotCount() const;
+
+    // Write the open blocks and the index, later snapshots are dropped
+    void Close();
+
+private:
+    struct OpenBlock
+    {
+        vector<char> bytes;
+        TickSnapshot last;          // previous snapshot in the block
+        uint64_t first_sequence;
+        uint32_t snapshot_count;
+        uint64_t total_count;       // snapshots of the product in the whole store
+    };
+
+    string file_name;
+    ofstream out;
+    uint32_t block_records;
+    uint64_t offset;
+    uint64_t next_sequence;
+    bool is_open;
+    vector<string> product_ids;
+    vector<OpenBlock> open_blocks;
+    vector<TickStoreBlock> blocks;
+
+    // Write a product's open block to the file
+    void WriteBlock(uint32_t product);
+};
+
+
+class TickStoreReader;
+
+/**
+ * Walks the snapshots of one product in a tick store, decoding one block at a time.
+ */
+class TickStoreCursor
+{
+public:
+    // ctor for a cursor that yields nothing
+    TickStoreCursor();
+
+    // Get the next snapshot, returns false once the product has no more
+    bool Next(TickSnapshot& snapshot);
+
+private:
+    friend class TickStoreReader;
+
+    const char* base;
+    const TickStoreBlock* block;        // block being decoded
+    const TickStoreBlock* end_block;
+    const char* pos;
+    const char* end;
+    uint32_t remaining;                 // snapshots left in the block
+    uint64_t from_sequence;             // earlier snapshots are skipped
+    TickSnapshot last;
+};
+
+
+/**
+ * Reads a closed tick store in place from a memory mapping.
+ */
+class TickStoreReader
+{
+public:
+    // ctor, maps the file; check IsOpen() for a valid, closed store
+    TickStoreReader(const string& file_name);
+
+    // Whether the file is a valid tick store
+    bool IsOpen() const;
+
+    // Get the number of products
+    uint32_t GetProductCount() const;
+
+    // Get the product id of a store product number
+    string_view GetProductId(uint32_t product) const;
+
+    // Find the store product number of a product id, returns false if the store does not have it
+    bool FindProduct(string_view product_id, uint32_t& product) const;
+
+    // Get the number of snapshots of a product
+    uint64_t GetSnapshotCount(uint32_t product) const;
+
+    // Get the number of blocks of a product
+    uint32_t GetBlockCount(uint32_t product) const;
+
+    // Get a cursor over the snapshots of a product from the first one whose sequence number is
+    // at least sequence. Only the blocks from there on are decoded.
+    TickStoreCursor Seek(uint32_t product, uint64_t sequence = 0) const;
+
+private:
+    MappedFile file;
+    TickStoreIndexHeader index;
+    const TickStoreProduct* products;
+    const TickStoreBlock* blocks;
+    bool is_open;
+};
+
+
+// Write an unsigned LEB128 varint, at most 10 bytes
+inline void PutVarint(char*& pos, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *pos++ = (char)(value | 0x80);
+        value >>= 7;
+    }
+    *pos++ = (char)value;
+}
+
+// Read an unsigned LEB128 varint, returns false if it runs past end
+inline bool GetVarint(const char*& pos, const char* end, uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; pos < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = (uint8_t)*pos++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Map a signed change to an unsigned one, small in magnitude either way
+inline uint64_t ZigZag(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+inline int64_t UnZigZag(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// Most bytes a snapshot can take when encoded
+const size_t TICK_SNAPSHOT_MAX_BYTES = 10 + 1 + 4 * TICK_STORE_DEPTH * 10;
+
+// Encode a snapshot against the previous one of its block
+void EncodeSnapshot(const TickSnapshot& last, const TickSnapshot& snapshot, vector<char>& out)
+{
+    size_t size = out.size();
+    out.resize(size + TICK_SNAPSHOT_MAX_BYTES);
+    char* pos = out.data() + size;
+    PutVarint(pos, snapshot.sequence - last.sequence);
+    *pos++ = (char)(snapshot.bid_levels | snapshot.offer_levels << 4);
+    for (uint32_t i = 0; i < TICK_STORE_DEPTH; ++i)
+    {
+        PutVarint(pos, ZigZag(snapshot.bid_ticks[i] - last.bid_ticks[i]));
+        PutVarint(pos, ZigZag(snapshot.bid_quantities[i] - last.bid_quantities[i]));
+        PutVarint(pos, ZigZag(snapshot.offer_ticks[i] - last.offer_ticks[i]));
+        PutVarint(pos, ZigZag(snapshot.offer_quantities[i] - last.offer_quantities[i]));
+    }
+    out.resize(pos - out.data());
+}
+
+// Decode a snapshot over the previous one of its block, returns false on a damaged block
+bool DecodeSnapshot(const char*& pos, const char* end, TickSnapshot& last)
+{
+    uint64_t value;
+    if (!GetVarint(pos, end, value) || pos >= end)
+        return false;
+    last.sequence += value;
+    uint8_t levels = (uint8_t)*pos++;
+    last.bid_levels = levels & 0x0f;
+    last.offer_levels = levels >> 4;
+    if (last.bid_levels > TICK_STORE_DEPTH || last.offer_levels > TICK_STORE_DEPTH)
+        return false;
+    for (uint32_t i = 0; i < TICK_STORE_DEPTH; ++i)
+    {
+        int64_t* fields[4] = { &last.bid_ticks[i], &last.bid_quantities[i], &last.offer_ticks[i], &last.offer_quantities[i] };
+        for (auto field : fields)
+        {
+            if (!GetVarint(pos, end, value))
+                return false;
+            *field += UnZigZag(value);
+        }
+    }
+    return true;
+}
+
+
+TickStoreWriter::TickStoreWriter(const string& _file_name, uint32_t _block_records) :
+    file_name(_file_name), out(_file_name, ios::binary | ios::trunc), block_records(_block_records < 1 ? 1 : _block_records),
+    offset(0), next_sequence(0), is_open(false)
+{
+    if (!out.is_open())
+    {
+        cout << "ERROR: File " << file_name << " can not be opened.\n";
+        return;
+    }
+    TickStoreHeader header = {};
+    memcpy(header.magic, TICK_STORE_MAGIC, sizeof(header.magic));
+    header.version = TICK_STORE_VERSION;
+    header.depth = TICK_STORE_DEPTH;
+    header.block_records = block_records;
+    out.write((const char*)&header, sizeof(header));
+    offset = sizeof(header);
+    is_open = (bool)out;
+}
+
+TickStoreWriter::~TickStoreWriter()
+{
+    Close();
+}
+
+bool TickStoreWriter::IsOpen() const
+{
+    return is_open;
+}
+
+uint32_t TickStoreWriter::AddProduct(string_view product_id)
+{
+    for (size_t i = 0; i < product_ids.size(); ++i)
+    {
+        if (product_ids[i] == product_id)
+            return (uint32_t)i;
+    }
+    product_ids.push_back(string(product_id.substr(0, sizeof(TickStoreProduct::product_id) - 1)));
+    OpenBlock block = {};
+    block.bytes.reserve(block_records * 32 + TICK_SNAPSHOT_MAX_BYTES);
+    open_blocks.push_back(block);
+    return (uint32_t)(product_ids.size() - 1);
+}
+
+uint64_t TickStoreWriter::Append(const TickSnapshot& snapshot)
+{
+    uint64_t sequence = next_sequence++;
+    if (!is_open || snapshot.product >= open_blocks.size())
+        return sequence;
+
+    OpenBlock& block = open_blocks[snapshot.product];
+    if (block.snapshot_count == 0)
+    {
+        block.last = TickSnapshot();
+        block.last.sequence = sequence;
+        block.first_sequence = sequence;
+    }
+    TickSnapshot current = snapshot;
+    current.sequence = sequence;
+    EncodeSnapshot(block.last, current, block.bytes);
+    block.last = current;
+    ++block.snapshot_count;
+    ++block.total_count;
+    if (block.snapshot_count == block_records)
+        WriteBlock(snapshot.product);
+    return sequence;
+}
+
+uint64_t TickStoreWriter::GetSnapshotCount() const
+{
+    return next_sequence;
+}
+
+void TickStoreWriter::Close()
+{
+    if (!is_open)
+        return;
+    for (uint32_t i = 0; i < open_blocks.size(); ++i)
+    {
+        if (open_blocks[i].snapshot_count > 0)
+            WriteBlock(i);
+    }
+
+    // blocks are written as they fill up, the index groups them by product
+    stable_sort(blocks.begin(), blocks.end(), [](const TickStoreBlock& a, const TickStoreBlock& b)
+    {
+        return a.product < b.product;
+    });
+    vector<TickStoreProduct> products(product_ids.size());
+    for (size_t i = 0; i < products.size(); ++i)
+    {
+        memset(&products[i], 0, sizeof(products[i]));
+        memcpy(products[i].product_id, product_ids[i].data(), product_ids[i].size());
+        products[i].snapshot_count = open_blocks[i].total_count;
+    }
+    for (uint32_t i = 0; i < blocks.size(); ++i)
+    {
+        TickStoreProduct& product = products[blocks[i].product];
+        if (product.block_count == 0)
+            product.first_block = i;
+        ++product.block_count;
+    }
+
+    const char padding[8] = {};
+    uint64_t index_offset = (offset + 7) & ~(uint64_t)7;
+    TickStoreIndexHeader index = { (uint32_t)products.size(), (uint32_t)blocks.size() };
+    out.write(padding, index_offset - offset);
+    out.write((const char*)&index, sizeof(index));
+    out.write((const char*)products.data(), products.size() * sizeof(TickStoreProduct));
+    out.write((const char*)blocks.data(), blocks.size() * sizeof(TickStoreBlock));
+    out.seekp(offsetof(TickStoreHeader, index_offset));
+    out.write((const char*)&index_offset, sizeof(index_offset));
+    out.close();
+    if (!out)
+        cout << "ERROR: File " << file_name << " could not be written.\n";
+    is_open = false;
+}
+
+void TickStoreWriter::WriteBlock(uint32_t product)
+{
+    OpenBlock& open = open_blocks[product];
+    TickStoreBlock block = {};
+    block.offset = offset;
+    block.first_sequence = open.first_sequence;
+    block.last_sequence = open.last.sequence;
+    block.product = product;
+    block.snapshot_count = open.snapshot_count;
+    block.bytes = (uint32_t)open.bytes.size();
+    blocks.push_back(block);
+
+    out.write(open.bytes.data(), open.bytes.size());
+    offset += open.bytes.size();
+    open.bytes.clear();
+    open.snapshot_count = 0;
+    if (!out)
+    {
+        cout << "ERROR: File " << file_name << " could not be written.\n";
+        is_open = false;
+    }
+}
+
+
+TickStoreCursor::TickStoreCursor() :
+    base(nullptr), block(nullptr), end_block(nullptr), pos(nullptr), end(nullptr), remaining(0), from_sequence(0), last()
+{
+}
+
+bool TickStoreCursor::Next(TickSnapshot& snapshot)
+{
+    while (true)
+    {
+        if (remaining == 0)
+        {
+            if (block == end_block)
+                return false;
+            pos = base + block->offset;
+            end = pos + block->bytes;
+            remaining = block->snapshot_count;
+            last = TickSnapshot();
+            last.sequence = block->first_sequence;
+            last.product = block->product;
+            ++block;
+        }
+        if (!DecodeSnapshot(pos, end, last))
+        {
+            block = end_block;
+            remaining = 0;
+            return false;
+        }
+        --remaining;
+        if (last.sequence >= from_sequence)
+        {
+            snapshot = last;
+            return true;
+        }
+    }
+}
+
+
+TickStoreReader::TickStoreReader(const string& file_name) :
+    file(file_name), index(), products(nullptr), blocks(nullptr), is_open(false)
+{
+    string_view data = file.GetData();
+    TickStoreHeader header;
+    if (!file.IsOpen() || data.size() < sizeof(header))
+        return;
+    memcpy(&header, data.data(), sizeof(header));
+    if (memcmp(header.magic, TICK_STORE_MAGIC, sizeof(header.magic)) != 0 || header.version != TICK_STORE_VERSION ||
+        header.depth != TICK_STORE_DEPTH || header.index_offset == 0 || header.index_offset + sizeof(index) > data.size())
+        return;
+
+    memcpy(&index, data.data() + header.index_offset, sizeof(index));
+    uint64_t offset = header.index_offset + sizeof(index);
+    products = (const TickStoreProduct*)(data.data() + offset);
+    offset += (uint64_t)index.product_count * sizeof(TickStoreProduct);
+    blocks = (const TickStoreBlock*)(data.data() + offset);
+    offset += (uint64_t)index.block_count * sizeof(TickStoreBlock);
+    if (offset > data.size())
+        return;
+    for (uint32_t i = 0; i < index.block_count; ++i)
+    {
+        if (blocks[i].offset + blocks[i].bytes > header.index_offset || blocks[i].product >= index.product_count)
+            return;
+    }
+    for (uint32_t i = 0; i < index.product_count; ++i)
+    {
+        if ((uint64_t)products[i].first_block + products[i].block_count > index.block_count)
+            return;
+    }
+    is_open = true;
+}
+
+bool TickStoreReader::IsOpen() const
+{
+    return is_open;
+}
+
+uint32_t TickStoreReader::GetProductCount() const
+{
+    return is_open ? index.product_count : 0;
+}
+
+string_view TickStoreReader::GetProductId(uint32_t product) const
+{
+    const char* id = products[product].product_id;
+    return string_view(id, strnlen(id, sizeof(products[product].product_id)));
+}
+
+bool TickStoreReader::FindProduct(string_view product_id, uint32_t& product) const
+{
+    for (uint32_t i = 0; i < GetProductCount(); ++i)
+    {
+        if (GetProductId(i) == product_id)
+        {
+            product = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t TickStoreReader::GetSnapshotCount(uint32_t product) const
+{
+    return products[product].snapshot_count;
+}
+
+uint32_t TickStoreReader::GetBlockCount(uint32_t product) const
+{
+    return products[product].block_count;
+}
+
+TickStoreCursor TickStoreReader::Seek(uint32_t product, uint64_t sequence) const
+{
+    TickStoreCursor cursor;
+    if (product >= GetProductCount())
+        return cursor;
+    const TickStoreBlock* first = blocks + products[product].first_block;
+    const TickStoreBlock* last = first + products[product].block_count;
+    // the first block that reaches the sequence number
+    cursor.block = lower_bound(first, last, sequence, [](const TickStoreBlock& block, uint64_t value)
+    {
+        return block.last_sequence < value;
+    });
+    cursor.base = file.GetData().data();
+    cursor.end_block = last;
+    cursor.from_sequence = sequence;
+    return cursor;
+}
+
+#endif
@@ -0,0 +1,408 @@
+
+#ifndef TIMER_SERVICE_HPP
+#define TIMER_SERVICE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <boost/date_time.hpp>
+
+using namespace std;
+using namespace boost::posix_time;
+
+// Handle of a scheduled timer, 0 is never one
+typedef uint64_t TimerId;
+
+
+/**
+ * Timers shared by the services, kept on a hierarchical timing wheel.
+ * Time advances in ticks of a fixed resolution. A timer due within 256 ticks waits in the
+ * slot of its tick on the first wheel, later ones on coarser wheels of 256 slots, each slot
+ * 256 times wider than on the wheel below; when a wheel comes round to a slot, its timers
+ * move down to the finer wheels. Scheduling and cancelling link and unlink a timer from a
+ * slot list, O(1) however many timers are pending. Advancing visits each tick's slot once,
+ * skipping stretches with no timer on the finer wheels up to their next cascade.
+ * Time is either driven with AdvanceTo(), e.g. by an event loop with event time, which runs
+ * the callbacks on the calling thread, or by Start(), which advances with the wall clock on a
+ * thread of its own. Any thread may schedule and cancel, callbacks included; only callbacks
+ * must not advance the time. Cancelling a timer whose callback is running on another thread
+ * waits for the callback to return, so its owner can be destroyed right after.
+ */
+class TimerService
+{
+public:
+    // ctor, time starts at _start and advances in steps of _resolution
+    TimerService(time_duration _resolution = millisec(1), ptime _start = microsec_clock::local_time());
+    ~TimerService();
+
+    TimerService(const TimerService&) = delete;
+    TimerService& operator=(const TimerService&) = delete;
+
+    // Run a callback once after a delay
+    TimerId Schedule(time_duration delay, function<void()> callback);
+
+    // Run a callback once at a time, on the next tick if the time has passed
+    TimerId ScheduleAt(ptime when, function<void()> callback);
+
+    // Run a callback every period, the first time one period from now
+    TimerId ScheduleEvery(time_duration period, function<void()> callback);
+
+    // Cancel a timer, false if it already ran or was cancelled. If its callback is due or running
+    // on another thread, waits until it has returned; a periodic timer does not run again.
+    // The caller must not hold anything the callback waits for.
+    bool Cancel(TimerId id);
+
+    // Advance the time, running the callbacks of the timers due by then tick by tick
+    void AdvanceTo(ptime time);
+
+    // Advance the time with the wall clock on a thread of its own, until Stop()
+    void Start();
+
+    // Stop the thread started by Start()
+    void Stop();
+
+    // Get the time as of the last advance
+    ptime GetTime();
+
+    // Get the number of timers waiting to run
+    size_t GetTimerCount();
+
+private:
+    static const int slot_bits = 8;
+    static const uint32_t slot_count = 1u << slot_bits;
+    static const int wheel_count = 4;
+    static const uint32_t no_timer = UINT32_MAX;
+
+    enum TimerState { FREE, PENDING, RUNNING, CANCELLED };
+
+    struct Timer
+    {
+        uint64_t due = 0;                   // tick
+        uint64_t period = 0;                // ticks, 0 for a timer that runs once
+        function<void()> callback;
+        uint32_t prev = no_timer;
+        uint32_t next = no_timer;           // also links the free list
+        uint32_t generation = 0;            // bumped on every reuse, so old ids do not match
+        uint16_t wheel = 0;
+        uint16_t slot = 0;
+        TimerState state = FREE;
+    };
+
+    time_duration resolution;
+    ptime start;
+    mutex timers_mutex;                     // guards everything down to due
+    deque<Timer> timers;                    // by index, a deque never moves a timer
+    uint32_t free_list = no_timer;
+    uint32_t slots[wheel_count][slot_count];    // first timer of each slot
+    size_t wheel_timers[wheel_count] = {};      // timers on each wheel
+    uint64_t now = 0;                       // current tick
+    size_t pending = 0;
+    vector<pair<uint32_t, function<void()>*> > due;     // timers whose callbacks run at the current tick
+    thread::id advancing_thread;            // thread running the due callbacks, none while none run
+    condition_variable callbacks_done;      // signalled when the due callbacks have returned
+    atomic<bool> running;
+    thread ticker;
+
+    // Get the tick a time falls in, rounded up or down
+    uint64_t ToTick(ptime time, bool round_up) const;
+
+    // Add a pending timer, timers_mutex must be held
+    TimerId Add(uint64_t due_tick, uint64_t period, function<void()>& callback);
+
+    // Put a pending timer in the slot its due tick falls in, timers_mutex must be held
+    void Link(uint32_t index);
+
+    // Take a timer out of its slot, timers_mutex must be held
+    void Unlink(uint32_t index);
+
+    // Return a timer to the free list, timers_mutex must be held
+    void Release(uint32_t index);
+
+    // Move the timers of a wheel's current slot down to the finer wheels, timers_mutex must be held
+    void Cascade(int wheel);
+
+    // Thread loop of Start()
+    void Tick();
+};
+
+
+TimerService::TimerService(time_duration _resolution, ptime _start) :
+    resolution(_resolution), start(_start), running(false)
+{
+    for (auto& wheel : slots)
+    {
+        for (auto& e : wheel)
+            e = no_timer;
+    }
+}
+
+TimerService::~TimerService()
+{
+    Stop();
+}
+
+TimerId TimerService::Schedule(time_duration delay, function<void()> callback)
+{
+    long long ticks = (delay.total_microseconds() + resolution.total_microseconds() - 1) / resolution.total_microseconds();
+    lock_guard<mutex> lock(timers_mutex);
+    return Add(now + (uint64_t)max(ticks, 1LL), 0, callback);
+}
+
+TimerId TimerService::ScheduleAt(ptime when, function<void()> callback)
+{
+    uint64_t tick = ToTick(when, true);
+    lock_guard<mutex> lock(timers_mutex);
+    return Add(max(tick, now + 1), 0, callback);
+}
+
+TimerId TimerService::ScheduleEvery(time_duration period, function<void()> callback)
+{
+    long long ticks = (period.total_microseconds() + resolution.total_microseconds() - 1) / resolution.total_microseconds();
+    uint64_t period_ticks = (uint64_t)max(ticks, 1LL);
+    lock_guard<mutex> lock(timers_mutex);
+    return Add(now + period_ticks, period_ticks, callback);
+}
+
+bool TimerService::Cancel(TimerId id)
+{
+    uint32_t index = (uint32_t)id;
+    uint32_t generation = (uint32_t)(id >> 32);
+    unique_lock<mutex> lock(timers_mutex);
+    if (index >= timers.size() || timers[index].generation != generation)
+        return false;
+    Timer& timer = timers[index];
+    if (timer.state == PENDING)
+    {
+        Unlink(index);
+        Release(index);
+        --pending;
+        return true;
+    }
+    if (timer.state != RUNNING)
+        return false;
+    timer.state = CANCELLED;
+    // a callback cancelling its own timer, or one due with it, must not wait for itself
+    if (advancing_thread != this_thread::get_id())
+    {
+        callbacks_done.wait(lock, [this, index, generation]()
+        {
+            return timers[index].generation != generation || timers[index].state != CANCELLED;
+        });
+    }
+    return true;
+}
+
+void TimerService::AdvanceTo(ptime time)
+{
+    uint64_t target = ToTick(time, false);
+    unique_lock<mutex> lock(timers_mutex);
+    while (now < target)
+    {
+        if (pending == 0)
+        {
+            now = target;       // nothing to move or run on the way
+            break;
+        }
+
+        // skip the ticks before the next one with a slot to run or cascade
+        int lowest = 0;
+        while (wheel_timers[lowest] == 0)
+            ++lowest;
+        if (lowest > 0)
+        {
+            uint64_t skip_to = ((now >> (slot_bits * lowest)) + 1) << (slot_bits * lowest);
+            now = min(skip_to, target + 1) - 1;
+            if (now == target)
+                break;
+        }
+        ++now;
+
+        // coarser wheels first, a timer may move down more than one wheel
+        int wheel = 1;
+        while (wheel < wheel_count && (now & ((1ULL << (slot_bits * wheel)) - 1)) == 0)
+            ++wheel;
+        for (--wheel; wheel > 0; --wheel)
+            Cascade(wheel);
+
+        uint32_t& head = slots[0][now & (slot_count - 1)];
+        if (head == no_timer)
+            continue;
+        due.clear();
+        for (uint32_t i = head; i != no_timer; i = timers[i].next)
+        {
+            due.push_back(make_pair(i, &timers[i].callback));
+            timers[i].state = RUNNING;
+        }
+        head = no_timer;
+        wheel_timers[0] -= due.size();
+        pending -= due.size();
+        advancing_thread = this_thread::get_id();
+
+        // run the callbacks unlocked, they may schedule and cancel; a deque keeps the timers
+        // in place, but its index may change as timers are added, so they are called by address
+        for (auto& e : due)
+        {
+            // an earlier callback may have cancelled a timer due on the same tick
+            if (timers[e.first].state != RUNNING)
+                continue;
+            lock.unlock();
+            (*e.second)();
+            lock.lock();
+        }
+
+        for (auto& e : due)
+        {
+            uint32_t i = e.first;
+            Timer& timer = timers[i];
+            if (timer.state == RUNNING && timer.period > 0)
+            {
+                timer.due = now + timer.period;
+                timer.state = PENDING;
+                Link(i);
+                ++pending;
+            }
+            else
+            {
+                Release(i);
+            }
+        }
+        advancing_thread = thread::id();
+        callbacks_done.notify_all();
+    }
+}
+
+void TimerService::Start()
+{
+    if (running.exchange(true))
+        return;
+    ticker = thread(&TimerService::Tick, this);
+}
+
+void TimerService::Stop()
+{
+    running = false;
+    if (ticker.joinable())
+        ticker.join();
+}
+
+ptime TimerService::GetTime()
+{
+    lock_guard<mutex> lock(timers_mutex);
+    return start + microseconds((long long)now * resolution.total_microseconds());
+}
+
+size_t TimerService::GetTimerCount()
+{
+    lock_guard<mutex> lock(timers_mutex);
+    return pending;
+}
+
+uint64_t TimerService::ToTick(ptime time, bool round_up) const
+{
+    long long us = (time - start).total_microseconds();
+    if (us <= 0)
+        return 0;
+    long long step = resolution.total_microseconds();
+    return (uint64_t)((round_up ? us + step - 1 : us) / step);
+}
+
+TimerId TimerService::Add(uint64_t due_tick, uint64_t period, function<void()>& callback)
+{
+    uint32_t index = free_list;
+    if (index == no_timer)
+    {
+        index = (uint32_t)timers.size();
+        timers.emplace_back();
+    }
+    else
+    {
+        free_list = timers[index].next;
+    }
+    Timer& timer = timers[index];
+    timer.due = due_tick;
+    timer.period = period;
+    timer.callback = move(callback);
+    timer.state = PENDING;
+    if (++timer.generation == 0)
+        timer.generation = 1;
+    Link(index);
+    ++pending;
+    return ((TimerId)timer.generation << 32) | index;
+}
+
+void TimerService::Link(uint32_t index)
+{
+    Timer& timer = timers[index];
+    uint64_t delta = timer.due - now;
+    int wheel = 0;
+    while (wheel < wheel_count - 1 && delta >= (1ULL << (slot_bits * (wheel + 1))))
+        ++wheel;
+    uint64_t slot = delta >= (1ULL << (slot_bits * wheel_count)) ?
+        (now >> (slot_bits * wheel)) + slot_count - 1 :     // beyond the wheels, wait in the farthest slot
+        timer.due >> (slot_bits * wheel);
+    timer.wheel = (uint16_t)wheel;
+    timer.slot = (uint16_t)(slot & (slot_count - 1));
+
+    uint32_t& head = slots[timer.wheel][timer.slot];
+    timer.prev = no_timer;
+    timer.next = head;
+    if (head != no_timer)
+        timers[head].prev = index;
+    head = index;
+    ++wheel_timers[timer.wheel];
+}
+
+void TimerService::Unlink(uint32_t index)
+{
+    Timer& timer = timers[index];
+    if (timer.prev == no_timer)
+        slots[timer.wheel][timer.slot] = timer.next;
+    else
+        timers[timer.prev].next = timer.next;
+    if (timer.next != no_timer)
+        timers[timer.next].prev = timer.prev;
+    --wheel_timers[timer.wheel];
+}
+
+void TimerService::Release(uint32_t index)
+{
+    Timer& timer = timers[index];
+    timer.callback = nullptr;
+    timer.state = FREE;
+    timer.next = free_list;
+    free_list = index;
+}
+
+void TimerService::Cascade(int wheel)
+{
+    uint32_t& head = slots[wheel][(now >> (slot_bits * wheel)) & (slot_count - 1)];
+    uint32_t i = head;
+    head = no_timer;
+    while (i != no_timer)
+    {
+        uint32_t next = timers[i].next;
+        --wheel_timers[wheel];
+        Link(i);
+        i = next;
+    }
+}
+
+void TimerService::Tick()
+{
+    chrono::microseconds step(resolution.total_microseconds());
+    while (running)
+    {
+        this_thread::sleep_for(step);
+        AdvanceTo(microsec_clock::local_time());
+    }
+}
+
+#endif
@@ -5,7 +5,9 @@
 
 #include <string>
 #include <map>
+#include <mutex>
 #include "SOA.hpp"
+#include "TickPrice.hpp"
 
 using namespace std;
 
@@ -20,9 +22,9 @@ template<typename T>
 class Trade
 {
 public:
-    // ctor for a trade
+    // ctor for a trade, the product is referenced and must outlive the trade
     Trade() = default;
-    Trade(const T& _product, string _tradeId, double _price, string _book, double _quantity, Side _side);
+    Trade(const T& _product, string _tradeId, TickPrice _price, string _book, double _quantity, Side _side);
 
     // Get the product
     const T& GetProduct() const;
@@ -31,7 +33,7 @@ public:
     const string& GetTradeId() const;
 
     // Get the mid price
-    double GetPrice() const;
+    TickPrice GetPrice() const;
 
     // Get the book
     const string& GetBook() const;
@@ -43,9 +45,9 @@ public:
     Side GetSide() const;
 
 private:
-    T product;
+    const T* product = nullptr;
     string tradeId;
-    double price;
+    TickPrice price;
     string book;
     double quantity;
     Side side;
@@ -55,13 +57,15 @@ private:
 /**
  * Trade Booking Service to book Trades to a particular book.
  * Keyed on trade id.
- * Type T is the product type.
+ * Safe for concurrent callers: bookings, and everything they notify downstream, are serialized.
+ * Type T is the product type, Chain the compile-time listener chain.
  */
-template<typename T>
-class TradeBookingService : public Service<string, Trade <T> >
+template<typename T, typename Chain = ListenerChain<Trade<T> > >
+class TradeBookingService : public Service<string, Trade <T>, Chain>
 {
 private:
     map<string, Trade<T>> trades;
+    mutex booking_mutex;
 
 public:
     // default constructor
@@ -75,11 +79,14 @@ public:
     
     // The callback that a Connector should invoke for any new or updated data
     void OnMessage(Trade <T>& data);
+
+    // The callback that a Connector should invoke for a block of new or updated data
+    void OnMessageBatch(vector<Trade<T> >& data);
 };
 
 template<typename T>
-Trade<T>::Trade(const T& _product, string _tradeId, double _price, string _book, double _quantity, Side _side) :
-    product(_product)
+Trade<T>::Trade(const T& _product, string _tradeId, TickPrice _price, string _book, double _quantity, Side _side) :
+    product(&_product)
 {
     tradeId = _tradeId;
     price = _price;
@@ -91,7 +98,7 @@ Trade<T>::Trade(const T& _product, string _tradeId, double _price, string _book,
 template<typename T>
 const T& Trade<T>::GetProduct() const
 {
-    return product;
+    return *product;
 }
 
 template<typename T>
@@ -101,7 +108,7 @@ const string& Trade<T>::GetTradeId() const
 }
 
 template<typename T>
-double Trade<T>::GetPrice() const
+TickPrice Trade<T>::GetPrice() const
 {
     return price;
 }
@@ -124,23 +131,37 @@ Side Trade<T>::GetSide() const
     return side;
 }
 
-template<typename T>
-void TradeBookingService<T>::BookTrade(Trade<T>& trade)
+template<typename T, typename Chain>
+void TradeBookingService<T, Chain>::BookTrade(Trade<T>& trade)
 {
-    Service<string, Trade<T> >::Notify(trade);
+    lock_guard<mutex> lock(booking_mutex);
+    Service<string, Trade<T>, Chain>::Notify(trade);
 }
 
-template <typename T>
-Trade<T>& TradeBookingService<T>::GetData(string key)
+template <typename T, typename Chain>
+Trade<T>& TradeBookingService<T, Chain>::GetData(string key)
 {
+    lock_guard<mutex> lock(booking_mutex);
     return trades[key];
 }
 
-template <typename T>
-void TradeBookingService<T>::OnMessage(Trade <T>& data)
+template <typename T, typename Chain>
+void TradeBookingService<T, Chain>::OnMessage(Trade <T>& data)
 {
+    lock_guard<mutex> lock(booking_mutex);
+    SOA_LATENCY_SCOPE("TradeBookingService::OnMessage");
     trades[data.GetTradeId()] = data;
-    Service<string, Trade<T> >::Notify(data);
+    Service<string, Trade<T>, Chain>::Notify(data);
+}
+
+template <typename T, typename Chain>
+void TradeBookingService<T, Chain>::OnMessageBatch(vector<Trade<T> >& data)
+{
+    lock_guard<mutex> lock(booking_mutex);
+    SOA_LATENCY_SCOPE("TradeBookingService::OnMessageBatch");
+    for (auto& e : data)
+        trades[e.GetTradeId()] = e;
+    Service<string, Trade<T>, Chain>::NotifyBatch(data);
 }
 
 #endif
@@ -0,0 +1,570 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "DataGenerator.hpp"
+#include "AlgoExecutionService.hpp"
+#include "BinaryFeed.hpp"
+#include "Connectors.hpp"
+#include "ConflatingServiceListener.hpp"
+#include "CsvScanner.hpp"
+#include "MarketDataService.hpp"
+#include "OutputFile.hpp"
+#include "PositionService.hpp"
+#include "TickStore.hpp"
+#include "TimerService.hpp"
+#include "Products.hpp"
+#include "TradeBookingService.hpp"
+
+using namespace std;
+
+/*
+* Microbenchmarks of the hot paths: fractional price parsing, the line parsing of every
+* connector, CSV field scanning, text, binary and synthetic feed replay, order book snapshots
+* and deltas, books consolidated across venues, best bid/offer and aggregated depth queries,
+* conflation of books for a slow consumer, timers, algo execution and position updates.
+* Inputs are generated with DataGenerator.hpp, --size records per product for each feed.
+* Each benchmark prints one JSON object per line to stdout with its ns/op and allocations/op,
+* progress messages go to stderr.
+*
+* Usage: trading_bench [--size=N] [--min-time-ms=N] [--filter=substring]
+*/
+
+
+// Every heap allocation goes through here so benchmarks can report allocations/op. All the
+// replaceable forms are replaced, over-aligned and nothrow included, and all free with free().
+atomic<long long> g_allocations(0);
+
+// Allocate and count, nullptr if out of memory
+void* CountedAllocate(size_t size, size_t alignment)
+{
+    g_allocations.fetch_add(1, memory_order_relaxed);
+    if (size == 0)
+        size = 1;
+    if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+        return malloc(size);
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+// Free what CountedAllocate() returned. Not inlined: after inlining a delete, the compiler
+// would see free() on the result of an operator new and warn of a mismatch.
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+void CountedFree(void* p) noexcept
+{
+    free(p);
+}
+
+void* operator new(size_t size)
+{
+    if (void* p = CountedAllocate(size, 0))
+        return p;
+    throw bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, align_val_t alignment)
+{
+    if (void* p = CountedAllocate(size, (size_t)alignment))
+        return p;
+    throw bad_alloc();
+}
+
+void* operator new[](size_t size, align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept
+{
+    return CountedAllocate(size, 0);
+}
+
+void* operator new[](size_t size, const nothrow_t&) noexcept
+{
+    return CountedAllocate(size, 0);
+}
+
+void* operator new(size_t size, align_val_t alignment, const nothrow_t&) noexcept
+{
+    return CountedAllocate(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, align_val_t alignment, const nothrow_t&) noexcept
+{
+    return CountedAllocate(size, (size_t)alignment);
+}
+
+void operator delete(void* p) noexcept { CountedFree(p); }
+void operator delete[](void* p) noexcept { CountedFree(p); }
+void operator delete(void* p, size_t) noexcept { CountedFree(p); }
+void operator delete[](void* p, size_t) noexcept { CountedFree(p); }
+void operator delete(void* p, align_val_t) noexcept { CountedFree(p); }
+void operator delete[](void* p, align_val_t) noexcept { CountedFree(p); }
+void operator delete(void* p, size_t, align_val_t) noexcept { CountedFree(p); }
+void operator delete[](void* p, size_t, align_val_t) noexcept { CountedFree(p); }
+void operator delete(void* p, const nothrow_t&) noexcept { CountedFree(p); }
+void operator delete[](void* p, const nothrow_t&) noexcept { CountedFree(p); }
+void operator delete(void* p, align_val_t, const nothrow_t&) noexcept { CountedFree(p); }
+void operator delete[](void* p, align_val_t, const nothrow_t&) noexcept { CountedFree(p); }
+
+
+// Keep the compiler from optimizing a result away
+template<typename T>
+inline void DoNotOptimize(const T& value)
+{
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static const volatile void* sink;
+    sink = &value;
+#endif
+}
+
+
+struct BenchmarkOptions
+{
+    int size = 10000;               // records per product in each generated feed
+    long long min_time_ms = 500;    // minimum timed duration of each benchmark
+    string filter;                  // only run benchmarks whose name contains this
+};
+
+
+// Run pass() until min_time_ms has elapsed, one pass performs ops_per_pass operations,
+// and print the result as one JSON object
+template<typename F>
+void RunBenchmark(const BenchmarkOptions& options, const string& name, size_t ops_per_pass, F pass)
+{
+    if (name.find(options.filter) == string::npos || ops_per_pass == 0)
+        return;
+
+    pass();     // warm up
+    long long ops = 0;
+    long long allocations = g_allocations.load(memory_order_relaxed);
+    auto start = chrono::steady_clock::now();
+    auto elapsed = chrono::steady_clock::duration::zero();
+    while (elapsed < chrono::milliseconds(options.min_time_ms))
+    {
+        pass();
+        ops += ops_per_pass;
+        elapsed = chrono::steady_clock::now() - start;
+    }
+    allocations = g_allocations.load(memory_order_relaxed) - allocations;
+    double ns = (double)chrono::duration_cast<chrono::nanoseconds>(elapsed).count();
+
+    cout << fixed << setprecision(2) << "{\"benchmark\":\"" << name << "\",\"size\":" << options.size
+        << ",\"ops\":" << ops << ",\"ns_per_op\":" << ns / ops
+        << ",\"allocs_per_op\":" << (double)allocations / ops << "}" << endl;
+}
+
+
+// Listener that only counts what it is handed, standing in for a slow consumer
+template<typename V>
+class CountingListener : public ServiceListener<V>
+{
+public:
+    atomic<long> count{0};
+
+    void ProcessAdd(V&) { count.fetch_add(1, memory_order_relaxed); }
+    void ProcessRemove(V&) { count.fetch_add(1, memory_order_relaxed); }
+    void ProcessUpdate(V&) { count.fetch_add(1, memory_order_relaxed); }
+};
+
+
+// Generate a feed with DataGenerator.hpp and read it back line by line
+vector<string> GenerateLines(void (*generate)(string, int), const string& file_name, int size)
+{
+    generate(file_name, size);
+    vector<string> lines;
+    ifstream in(file_name);
+    string line;
+    while (getline(in, line))
+        lines.push_back(line);
+    in.close();
+    remove(file_name.c_str());
+    return lines;
+}
+
+
+int main(int argc, char* argv[])
+{
+    BenchmarkOptions options;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg.compare(0, 7, "--size=") == 0)
+            options.size = stoi(arg.substr(7));
+        else if (arg.compare(0, 14, "--min-time-ms=") == 0)
+            options.min_time_ms = stoll(arg.substr(14));
+        else if (arg.compare(0, 9, "--filter=") == 0)
+            options.filter = arg.substr(9);
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--size=N] [--min-time-ms=N] [--filter=substring]\n";
+            return 1;
+        }
+    }
+
+    LoadBondCatalog();
+
+    // the generators report progress on cout, keep stdout for the results
+    streambuf* stdout_buf = cout.rdbuf(cerr.rdbuf());
+    vector<string> trade_lines = GenerateLines(Generate_Trades, "bench_trades.txt", options.size);
+    vector<string> price_lines = GenerateLines(Generate_Prices, "bench_prices.txt", options.size);
+    vector<string> mktdata_lines = GenerateLines(Generate_Mktdata, "bench_marketdata.txt", options.size);
+    vector<string> inquiry_lines = GenerateLines(Generate_Inquiry, "bench_inquiries.txt", options.size);
+    cout.rdbuf(stdout_buf);
+
+    TradeBookingConnector<Bond> trade_connector(nullptr);
+    PricingConnector<Bond> pricing_connector(nullptr);
+    MarketDataConnector<Bond> market_data_connector(nullptr);
+    InquiryConnector<Bond> inquiry_connector(nullptr);
+
+    vector<string> fractional_prices;
+    for (auto& line : price_lines)
+    {
+        size_t first = line.find(',');
+        size_t second = line.find(',', first + 1);
+        fractional_prices.push_back(line.substr(first + 1, second - first - 1));
+        fractional_prices.push_back(line.substr(second + 1));
+    }
+    vector<Trade<Bond> > trades(trade_lines.size());
+    for (size_t i = 0; i < trade_lines.size(); ++i)
+        trade_connector.ParseLine(trade_lines[i], trades[i]);
+    vector<OrderBook<Bond> > orderbooks(mktdata_lines.size());
+    for (size_t i = 0; i < mktdata_lines.size(); ++i)
+        market_data_connector.ParseLine(mktdata_lines[i], orderbooks[i]);
+
+    RunBenchmark(options, "FractionalToPrice", fractional_prices.size(), [&]()
+    {
+        for (auto& e : fractional_prices)
+            DoNotOptimize(FractionalToPrice(e));
+    });
+
+    vector<string_view> fractional_views(fractional_prices.begin(), fractional_prices.end());
+    vector<long long> ticks(fractional_views.size());
+    RunBenchmark(options, "FractionalToTicks(batch)", fractional_views.size(), [&]()
+    {
+        FractionalToTicks(fractional_views.data(), fractional_views.size(), ticks.data());
+        DoNotOptimize(ticks.back());
+    });
+
+    RunBenchmark(options, "TradeBookingConnector::ParseLine", trade_lines.size(), [&]()
+    {
+        Trade<Bond> trade;
+        for (auto& e : trade_lines)
+            DoNotOptimize(trade_connector.ParseLine(e, trade));
+    });
+
+    RunBenchmark(options, "PricingConnector::ParseLine", price_lines.size(), [&]()
+    {
+        Price<Bond> price;
+        for (auto& e : price_lines)
+            DoNotOptimize(pricing_connector.ParseLine(e, price));
+    });
+
+    RunBenchmark(options, "MarketDataConnector::ParseLine", mktdata_lines.size(), [&]()
+    {
+        OrderBook<Bond> orderbook;
+        for (auto& e : mktdata_lines)
+            DoNotOptimize(market_data_connector.ParseLine(e, orderbook));
+    });
+
+    RunBenchmark(options, "InquiryConnector::ParseLine", inquiry_lines.size(), [&]()
+    {
+        Inquiry<Bond> inquiry;
+        for (auto& e : inquiry_lines)
+            DoNotOptimize(inquiry_connector.ParseLine(e, inquiry));
+    });
+
+    string mktdata_block;
+    for (auto& e : mktdata_lines)
+        mktdata_block += e + "\n";
+    auto scan_block = [&](DelimiterScanFn scan)
+    {
+        CsvScanner scanner(mktdata_block, scan);
+        string_view line, fields[11];
+        size_t field_count;
+        while (scanner.NextLine(line, fields, 11, field_count))
+            DoNotOptimize(fields[field_count - 1]);
+    };
+    RunBenchmark(options, "CsvScanner::NextLine(scalar)", mktdata_lines.size(), [&]()
+    {
+        scan_block(ScanDelimitersScalar);
+    });
+    RunBenchmark(options, string("CsvScanner::NextLine(") + SelectedDelimiterScannerName() + ")", mktdata_lines.size(), [&]()
+    {
+        scan_block(SelectDelimiterScanner());
+    });
+
+    // regenerating the market data feed, one op per line
+    RunBenchmark(options, "Generate_Mktdata", mktdata_lines.size(), [&]()
+    {
+        streambuf* buf = cout.rdbuf(cerr.rdbuf());      // progress messages
+        Generate_Mktdata("bench_generated.txt", options.size);
+        cout.rdbuf(buf);
+    });
+    remove("bench_generated.txt");
+
+    // whole-file replays of the market data feed, text against the binary feed format
+    {
+        ofstream out("bench_marketdata.txt");
+        out << mktdata_block;
+    }
+    ConvertTextFeed("bench_marketdata.txt", "bench_marketdata.bin", MARKET_DATA_FEED);
+    MarketDataService<Bond> replay_service;
+    MarketDataConnector<Bond> replay_connector(&replay_service);
+    MarketDataConnector<Bond> parallel_replay_connector(&replay_service, 512, thread::hardware_concurrency());
+    auto replay = [&](bool binary, MarketDataConnector<Bond>& connector)
+    {
+        streambuf* buf = cout.rdbuf(cerr.rdbuf());      // progress messages
+        if (binary)
+            connector.SubscribeBinary("bench_marketdata.bin");
+        else
+            connector.Subscribe("bench_marketdata.txt");
+        cout.rdbuf(buf);
+    };
+    RunBenchmark(options, "MarketDataConnector::Subscribe", mktdata_lines.size(), [&]()
+    {
+        replay(false, replay_connector);
+    });
+    RunBenchmark(options, "MarketDataConnector::Subscribe(parallel)", mktdata_lines.size(), [&]()
+    {
+        replay(false, parallel_replay_connector);
+    });
+    RunBenchmark(options, "MarketDataConnector::SubscribeBinary", mktdata_lines.size(), [&]()
+    {
+        replay(true, replay_connector);
+    });
+    // the same number of books generated in memory instead of read from a file
+    SyntheticFeedOptions synthetic_options;
+    synthetic_options.product_count = g_generator_options.product_count;
+    synthetic_options.count_per_product = options.size;
+    RunBenchmark(options, "MarketDataConnector::SubscribeSynthetic", mktdata_lines.size(), [&]()
+    {
+        streambuf* buf = cout.rdbuf(cerr.rdbuf());      // progress messages
+        replay_connector.SubscribeSynthetic(synthetic_options);
+        cout.rdbuf(buf);
+    });
+    remove("bench_marketdata.txt");
+    remove("bench_marketdata.bin");
+
+    // storing each book in the service, one copy per book
+    MarketDataService<Bond> market_data_service;
+    RunBenchmark(options, "MarketDataService::OnMessage", orderbooks.size(), [&]()
+    {
+        for (auto& e : orderbooks)
+            market_data_service.OnMessage(e);
+    });
+
+    // the same books spread over the venues, each merged into its product's consolidated book
+    vector<OrderBook<Bond> > venue_orderbooks;
+    for (size_t i = 0; i < orderbooks.size(); ++i)
+    {
+        const OrderBook<Bond>& book = orderbooks[i];
+        OrderBook<Bond> venue_book(book.GetProduct(), (Market)(i % MARKET_COUNT));
+        for (size_t j = 0; j < book.GetBidDepth(); ++j)
+            venue_book.AddBid(book.GetBidPrice(j), book.GetBidQuantity(j));
+        for (size_t j = 0; j < book.GetOfferDepth(); ++j)
+            venue_book.AddOffer(book.GetOfferPrice(j), book.GetOfferQuantity(j));
+        venue_orderbooks.push_back(venue_book);
+    }
+    MarketDataService<Bond> venue_market_data_service;
+    RunBenchmark(options, "MarketDataService::OnMessage(venues)", venue_orderbooks.size(), [&]()
+    {
+        for (auto& e : venue_orderbooks)
+            venue_market_data_service.OnMessage(e);
+    });
+    // reading the consolidated levels after every book, the merge a reader of each update pays
+    RunBenchmark(options, "MarketDataService::GetConsolidatedBook", venue_orderbooks.size(), [&]()
+    {
+        for (auto& e : venue_orderbooks)
+        {
+            venue_market_data_service.OnMessage(e);
+            DoNotOptimize(venue_market_data_service.GetConsolidatedBook(e.GetProduct().GetProductIndex()).GetLevelCount(BID));
+        }
+    });
+
+    // the same books as one level update per book, applied in place
+    vector<OrderBookDelta<Bond> > deltas;
+    for (size_t i = 0; i < orderbooks.size(); ++i)
+    {
+        const OrderBook<Bond>& book = orderbooks[i];
+        uint32_t level = (uint32_t)(i % book.GetBidDepth());
+        PricingSide side = i % 2 == 0 ? BID : OFFER;
+        deltas.push_back(OrderBookDelta<Bond>(book.GetProduct(), book.GetVenue(), 0, side, LEVEL_UPDATE, level,
+            side == BID ? book.GetBidPrice(level) : book.GetOfferPrice(level),
+            side == BID ? book.GetBidQuantity(level) : book.GetOfferQuantity(level)));
+    }
+    vector<uint64_t> delta_sequences(g_product_Ids.size());
+    RunBenchmark(options, "MarketDataService::OnDelta", deltas.size(), [&]()
+    {
+        for (auto& e : deltas)
+        {
+            // sequence numbers keep rising across runs, so no delta is dropped as stale
+            OrderBookDelta<Bond> delta(e.GetProduct(), e.GetVenue(), ++delta_sequences[e.GetProduct().GetProductIndex()], e.GetSide(),
+                e.GetAction(), e.GetLevel(), e.GetPrice(), e.GetQuantity());
+            market_data_service.OnDelta(delta);
+        }
+    });
+    RunBenchmark(options, "MarketDataService::GetBestBidOffer", orderbooks.size(), [&]()
+    {
+        for (size_t i = 0; i < orderbooks.size(); ++i)
+            DoNotOptimize(market_data_service.GetBestBidOffer(g_product_Ids[i % g_product_Ids.size()]));
+    });
+    vector<int> product_indices;
+    for (auto& e : g_product_Ids)
+        product_indices.push_back(ProductIndex::Find(e));
+    RunBenchmark(options, "MarketDataService::GetBestBidOffer(index)", orderbooks.size(), [&]()
+    {
+        for (size_t i = 0; i < orderbooks.size(); ++i)
+            DoNotOptimize(market_data_service.GetBestBidOffer(product_indices[i % product_indices.size()]));
+    });
+
+    // sweep queries against the kept aggregated depth, one per book
+    RunBenchmark(options, "AggregatedDepth::GetSizeUpTo", orderbooks.size(), [&]()
+    {
+        for (size_t i = 0; i < orderbooks.size(); ++i)
+        {
+            const AggregatedDepth<>& depth = market_data_service.GetAggregatedDepth(product_indices[i % product_indices.size()], BROKERTEC);
+            DoNotOptimize(depth.GetSizeUpTo(OFFER, orderbooks[i].GetOfferPrice(0)));
+        }
+    });
+    RunBenchmark(options, "AggregatedDepth::GetPriceToFill", orderbooks.size(), [&]()
+    {
+        TickPrice price;
+        for (size_t i = 0; i < orderbooks.size(); ++i)
+        {
+            const AggregatedDepth<>& depth = market_data_service.GetAggregatedDepth(product_indices[i % product_indices.size()], BROKERTEC);
+            DoNotOptimize(depth.GetPriceToFill(BID, 1000000 * (long)(i % 15 + 1), price));
+        }
+        DoNotOptimize(price);
+    });
+
+    // handing books to a consumer thread that keeps only the latest of each product
+    CountingListener<OrderBook<Bond> > counting_listener;
+    {
+        ConflatingServiceListener<OrderBook<Bond> > conflating_listener(&counting_listener);
+        RunBenchmark(options, "ConflatingServiceListener::ProcessAdd", orderbooks.size(), [&]()
+        {
+            for (auto& e : orderbooks)
+                conflating_listener.ProcessAdd(e);
+        });
+        conflating_listener.Stop();
+        if (conflating_listener.GetProcessed() > 0)
+            cerr << "ConflatingServiceListener: " << conflating_listener.GetProcessed() << " delivered, "
+                << conflating_listener.GetConflated() << " conflated\n";
+    }
+
+    // timers in event time: scheduling and cancelling among pending timers, then running them
+    TimerService timer_service(millisec(1), ptime(date(2024, 1, 1)));
+    vector<time_duration> timer_delays(orderbooks.size());
+    for (size_t i = 0; i < timer_delays.size(); ++i)
+        timer_delays[i] = millisec((long)(i * 7919 % 65536 + 1));
+    long timer_calls = 0;
+    vector<TimerId> timer_ids(timer_delays.size());
+    RunBenchmark(options, "TimerService::Schedule+Cancel", timer_delays.size(), [&]()
+    {
+        for (size_t i = 0; i < timer_delays.size(); ++i)
+            timer_ids[i] = timer_service.Schedule(timer_delays[i], [&]() { ++timer_calls; });
+        for (auto& e : timer_ids)
+            timer_service.Cancel(e);
+    });
+    RunBenchmark(options, "TimerService::AdvanceTo", timer_delays.size(), [&]()
+    {
+        for (auto& e : timer_delays)
+            timer_service.Schedule(e, [&]() { ++timer_calls; });
+        timer_service.AdvanceTo(timer_service.GetTime() + millisec(65536));
+    });
+    DoNotOptimize(timer_calls);
+
+    AlgoExecutionService<Bond> algo_execution_service;
+    RunBenchmark(options, "AlgoExecutionService::ExecuteOrder", orderbooks.size(), [&]()
+    {
+        for (auto& e : orderbooks)
+            algo_execution_service.ExecuteOrder(e);
+    });
+
+    PositionService<Bond> position_service;
+    RunBenchmark(options, "PositionService::AddTrade", trades.size(), [&]()
+    {
+        for (auto& e : trades)
+            position_service.AddTrade(e);
+    });
+
+    // order book history: appending to the tick store, then reading it back
+    vector<TickSnapshot> snapshots(orderbooks.size());
+    {
+        TickStoreWriter store("bench_store.tick");
+        for (size_t i = 0; i < orderbooks.size(); ++i)
+        {
+            const OrderBook<Bond>& book = orderbooks[i];
+            TickSnapshot& e = snapshots[i];
+            e.product = store.AddProduct(book.GetProduct().GetProductId());
+            e.bid_levels = e.offer_levels = TICK_STORE_DEPTH;
+            for (uint32_t j = 0; j < TICK_STORE_DEPTH; ++j)
+            {
+                e.bid_ticks[j] = book.GetBidPrice(j).GetTicks();
+                e.bid_quantities[j] = book.GetBidQuantity(j);
+                e.offer_ticks[j] = book.GetOfferPrice(j).GetTicks();
+                e.offer_quantities[j] = book.GetOfferQuantity(j);
+            }
+        }
+        RunBenchmark(options, "TickStoreWriter::Append", snapshots.size(), [&]()
+        {
+            for (auto& e : snapshots)
+                store.Append(e);
+        });
+    }
+    TickStoreReader store_reader("bench_store.tick");
+    RunBenchmark(options, "TickStoreCursor::Next", snapshots.size(), [&]()
+    {
+        TickSnapshot snapshot;
+        size_t count = 0;
+        for (uint32_t product = 0; product < store_reader.GetProductCount() && count < snapshots.size(); ++product)
+        {
+            TickStoreCursor cursor = store_reader.Seek(product);
+            while (count < snapshots.size() && cursor.Next(snapshot))
+                ++count;
+        }
+        DoNotOptimize(snapshot);
+    });
+    remove("bench_store.tick");
+
+    // one streaming-style record per order book, buffered against reopening the file for each record
+    OutputFile& output_file = OutputRegistry::Instance().Get("bench_output.txt");
+    RunBenchmark(options, "OutputFile::Write", orderbooks.size(), [&]()
+    {
+        for (auto& e : orderbooks)
+        {
+            OutputWriter out(output_file);
+            out.Stream() << e.GetProduct().GetProductId() << ", " << e.GetBidPrice(0) << ", "
+                << e.GetOfferPrice(0) << '\n';
+        }
+    });
+    RunBenchmark(options, "ofstream(append)::Write", orderbooks.size(), [&]()
+    {
+        for (auto& e : orderbooks)
+        {
+            ofstream out("bench_output.txt", ios::app);
+            out << e.GetProduct().GetProductId() << ", " << e.GetBidPrice(0) << ", "
+                << e.GetOfferPrice(0) << '\n';
+        }
+    });
+    OutputRegistry::Instance().Flush();
+    remove("bench_output.txt");
+
+    return 0;
+}
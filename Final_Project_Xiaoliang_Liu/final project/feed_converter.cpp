@@ -0,0 +1,30 @@
+#include <iostream>
+#include <string>
+
+#include "BinaryFeed.hpp"
+
+using namespace std;
+
+/*
+* Converts a text feed made by DataGenerator.hpp into the binary columnar format of BinaryFeed.hpp,
+* which PricingConnector::SubscribeBinary and MarketDataConnector::SubscribeBinary replay.
+*
+* Usage: feed_converter prices input/prices.txt input/prices.bin
+*        feed_converter marketdata input/marketdata.txt input/marketdata.bin
+*/
+
+int main(int argc, char* argv[])
+{
+    string kind = argc == 4 ? argv[1] : "";
+    if (kind != "prices" && kind != "marketdata")
+    {
+        cerr << "Usage: " << argv[0] << " <prices|marketdata> <text file> <binary file>\n";
+        return 1;
+    }
+
+    BinaryFeedSchema schema = kind == "prices" ? PRICE_FEED : MARKET_DATA_FEED;
+    if (!ConvertTextFeed(argv[2], argv[3], schema))
+        return 1;
+    cout << "Converted " << argv[2] << " to " << argv[3] << ".\n";
+    return 0;
+}
@@ -3,6 +3,7 @@
 #include "DataGenerator.hpp"
 #include "AlgoExecutionService.hpp"
 #include "AlgoStreamingService.hpp"
+#include "AsyncServiceListener.hpp"
 #include "Connectors.hpp"
 #include "ExecutionService.hpp"
 #include "GUIService.hpp"
@@ -10,52 +11,161 @@
 #include "InquiryService.hpp"
 #include "Listeners.hpp"
 #include "MarketDataService.hpp"
+#include "PipelineRunner.hpp"
 #include "PositionService.hpp"
 #include "PricingService.hpp"
 #include "Products.hpp"
 #include "RiskService.hpp"
 #include "SOA.hpp"
 #include "StreamingService.hpp"
+#include "TimerService.hpp"
 #include "TradeBookingService.hpp"
 
 using namespace std;
 
-void Generate_Data()
+// Records per product in each generated input file
+struct DataSizes
 {
-    Generate_Trades("input/trades.txt");
+    int trades = 10;
+    int prices = 1000000;
+    int marketdata = 1000000;
+    int deltas = 0;             // level updates replayed after the books, none by default
+    int inquiries = 10;
+};
 
-    Generate_Prices("input/prices.txt");
+void Generate_Data(const DataSizes& sizes)
+{
+    Generate_Trades("input/trades.txt", sizes.trades);
+
+    Generate_Prices("input/prices.txt", sizes.prices);
+
+    Generate_Mktdata("input/marketdata.txt", sizes.marketdata);
+
+    if (sizes.deltas > 0)
+        Generate_MktdataDeltas("input/marketdata_deltas.txt", sizes.deltas);
+
+    Generate_Inquiry("input/inquiries.txt", sizes.inquiries);
+}
+
+
+/*
+* Static topology of the hot paths. Every service carries a compile-time ListenerChain of its
+* downstream listeners, so a message runs through a whole path without virtual dispatch and
+* the compiler can inline it into one function. Ad-hoc listeners can still be attached with
+* AddListener() on any of these services. The historical streaming, execution and market data
+* writers sit behind AsyncServiceListener so file output runs on its own thread, off the price
+* and market data paths.
+*/
 
-    Generate_Mktdata("input/marketdata.txt");
+// Part (a): trade booking service -> position service -> risk service
+using BondRiskService = RiskService<Bond, ListenerChain<PV01<Bond>, HistoricalRiskListener<Bond> > >;
+using BondPositionService = PositionService<Bond, ListenerChain<Position<Bond>,
+    RiskServiceListener<Bond, BondRiskService>, HistoricalPositionListener<Bond> > >;
+using BondTradeBookingService = TradeBookingService<Bond, ListenerChain<Trade<Bond>,
+    PositionServiceListener<Bond, BondPositionService> > >;
 
-    Generate_Inquiry("input/inquiries.txt");
+// Part (b): pricing service -> gui service, pricing service -> algo streaming service -> streaming service
+using BondStreamingService = StreamingService<Bond, ListenerChain<PriceStream<Bond>, AsyncServiceListener<PriceStream<Bond> > > >;
+using BondAlgoStreamingService = AlgoStreamingService<Bond, ListenerChain<PriceStream<Bond>,
+    StreamingServiceListener<Bond, BondStreamingService> > >;
+using BondPricingService = PricingService<Bond, ListenerChain<Price<Bond>,
+    GUIServiceListener<Bond>, AlgoStreamingServiceListener<Bond, BondAlgoStreamingService> > >;
+
+// Part (c): market data service -> algo execution service -> execution service -> trade booking service
+using BondExecutionService = ExecutionService<Bond, ListenerChain<ExecutionOrder<Bond>,
+    TradeBookingServiceListener<Bond, BondTradeBookingService>, AsyncServiceListener<ExecutionOrder<Bond> > > >;
+using BondAlgoExecutionService = AlgoExecutionService<Bond, ListenerChain<ExecutionOrder<Bond>,
+    ExecutionServiceListener<Bond, BondExecutionService> > >;
+using BondMarketDataService = MarketDataService<Bond, ListenerChain<OrderBook<Bond>,
+    AlgoExecutionServiceListener<Bond, BondAlgoExecutionService>, AsyncServiceListener<OrderBook<Bond> > > >;
+
+
+// Settings of a synthetic feed with the records per product of one input file
+SyntheticFeedOptions FeedOptions(const SyntheticFeedOptions& options, int count_per_product)
+{
+    SyntheticFeedOptions feed = options;
+    feed.count_per_product = (uint64_t)max(count_per_product, 0);
+    return feed;
 }
 
 
-int main()
+/*
+* Usage: trading_system [--seed=N] [--threads=N] [--products=N]
+*                       [--trades=N] [--prices=N] [--marketdata=N] [--deltas=N] [--inquiries=N]
+*                       [--synthetic [--rate=N] [--duration=S]]
+* The input files are generated from the seed, the same seed gives the same files. --threads
+* sets the generator threads, one per core by default, and --products the number of products
+* in each file. The next five set the records per product of each file; --deltas also writes
+* input/marketdata_deltas.txt, level updates applied to the books after marketdata.txt.
+* With --synthetic no files are written or read: each connector generates its records in memory
+* and hands them straight to its service. --rate caps each feed at N records a second, by default
+* they run as fast as the services take them, and --duration ends the feeds after S seconds.
+* There a count of 0 makes the feed endless.
+*/
+int main(int argc, char* argv[])
 {
-    Generate_Data();       
+    DataSizes sizes;
+    bool synthetic = false;
+    SyntheticFeedOptions synthetic_options;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg.compare(0, 7, "--seed=") == 0)
+            g_generator_options.seed = stoull(arg.substr(7));
+        else if (arg.compare(0, 10, "--threads=") == 0)
+            g_generator_options.threads = stoul(arg.substr(10));
+        else if (arg.compare(0, 11, "--products=") == 0)
+            g_generator_options.product_count = stoul(arg.substr(11));
+        else if (arg.compare(0, 9, "--trades=") == 0)
+            sizes.trades = stoi(arg.substr(9));
+        else if (arg.compare(0, 9, "--prices=") == 0)
+            sizes.prices = stoi(arg.substr(9));
+        else if (arg.compare(0, 13, "--marketdata=") == 0)
+            sizes.marketdata = stoi(arg.substr(13));
+        else if (arg.compare(0, 9, "--deltas=") == 0)
+            sizes.deltas = stoi(arg.substr(9));
+        else if (arg.compare(0, 12, "--inquiries=") == 0)
+            sizes.inquiries = stoi(arg.substr(12));
+        else if (arg == "--synthetic")
+            synthetic = true;
+        else if (arg.compare(0, 7, "--rate=") == 0)
+            synthetic_options.rate = stod(arg.substr(7));
+        else if (arg.compare(0, 11, "--duration=") == 0)
+            synthetic_options.duration = stod(arg.substr(11));
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--seed=N] [--threads=N] [--products=N] [--trades=N] [--prices=N]"
+                << " [--marketdata=N] [--deltas=N] [--inquiries=N] [--synthetic [--rate=N] [--duration=S]]\n";
+            return 1;
+        }
+    }
+    synthetic_options.seed = g_generator_options.seed;
+    synthetic_options.product_count = g_generator_options.product_count;
 
-    TradeBookingService<Bond> trade_booking_service;
-    PositionService<Bond> position_service;
-    PositionServiceListener<Bond> position_listener(&position_service);
+    if (!synthetic)
+        Generate_Data(sizes);
+
+    // Load the bond reference data, which also assigns the dense product indices
+    LoadBondCatalog();
+
+    BondTradeBookingService trade_booking_service;
+    BondPositionService position_service;
+    PositionServiceListener<Bond, BondPositionService> position_listener(&position_service);
     // The trade booking service should be linked to a position service via listener
-    trade_booking_service.AddListener(&position_listener);
+    trade_booking_service.GetListenerChain().Bind(&position_listener);
 
-    RiskService<Bond> risk_service;
-    RiskServiceListener<Bond> risk_service_listener(&risk_service);
-    // The position service should be linked to a risk service via listener
-    position_service.AddListener(&risk_service_listener);
+    BondRiskService risk_service;
+    RiskServiceListener<Bond, BondRiskService> risk_service_listener(&risk_service);
 
     HistoricalPositionService<Bond> historical_position_service;
     HistoricalPositionListener<Bond> historical_position_listener(&historical_position_service);
-    // Link the position service to the historical position listener
-    position_service.AddListener(&historical_position_listener);
+    // The position service should be linked to a risk service and the historical position listener
+    position_service.GetListenerChain().Bind(&risk_service_listener, &historical_position_listener);
 
     HistoricalRiskService<Bond> historical_risk_service;
     HistoricalRiskListener<Bond> historical_risk_listener(&historical_risk_service);
     // Link the risk service to the historical risk listener
-    risk_service.AddListener(&historical_risk_listener);
+    risk_service.GetListenerChain().Bind(&historical_risk_listener);
 
     /*
     * Part (b). Process price data from input/prices.txt
@@ -66,57 +176,67 @@ int main()
        -> streaming.txt
     */
 
-    GUIService<Bond> gui_service;
+    // the GUI throttle publishes from the timer thread
+    TimerService timer_service;
+    timer_service.Start();
+    GUIService<Bond> gui_service(&timer_service);
     GUIServiceListener<Bond> gui_listener(&gui_service);
-    PricingService<Bond> pricing_service;
-    // Link the pricing service to the gui listener
-    pricing_service.AddListener(&gui_listener);
+    BondPricingService pricing_service;
 
-    AlgoStreamingService<Bond> algo_streaming_service;
-    AlgoStreamingServiceListener<Bond> algo_streaming_listener(&algo_streaming_service);
-    // Link the pricing service to the algo streaming listener
-    pricing_service.AddListener(&algo_streaming_listener);
+    BondAlgoStreamingService algo_streaming_service;
+    AlgoStreamingServiceListener<Bond, BondAlgoStreamingService> algo_streaming_listener(&algo_streaming_service);
+    // Link the pricing service to the gui listener and the algo streaming listener
+    pricing_service.GetListenerChain().Bind(&gui_listener, &algo_streaming_listener);
 
-    StreamingService<Bond> streaming_service;
-    StreamingServiceListener<Bond> streaming_listener(&streaming_service);
+    BondStreamingService streaming_service;
+    StreamingServiceListener<Bond, BondStreamingService> streaming_listener(&streaming_service);
     // Link the algo streaming service to the streaming listener
-    algo_streaming_service.AddListener(&streaming_listener);
+    algo_streaming_service.GetListenerChain().Bind(&streaming_listener);
 
     HistoricalStreamingService<Bond> historical_streaming_service;
     HistoricalStreamingListener<Bond> historical_streaming_listener(&historical_streaming_service);
+    AsyncServiceListener<PriceStream<Bond> > async_streaming_listener(&historical_streaming_listener);
     // Link the streaming service to the historcial streaming listener
-    streaming_service.AddListener(&historical_streaming_listener);
+    streaming_service.GetListenerChain().Bind(&async_streaming_listener);
 
     /*
     * Part (c). Process order book data from input/marketorder.txt
-    * Generate one file: output/execution.txt
+    * Generate two files: output/execution.txt and output/marketdata.tick
     * Update two files: output/positions.txt and outpout/risk.txt
     * 
     * marketdata.txt -> market data service -> algo execution service -> execution service -> historical execution
         service -> executions.txt
+    * marketdata.txt -> market data service -> historical market data service -> marketdata.tick
     * marketdata.txt -> market data service -> algo execution service -> execution service -> trade booking service
         -> same as part (a)
+    * marketdata_deltas.txt -> market data service -> algo execution service, for updates that can move a top of book
     */
 
-    MarketDataService<Bond> market_data_service;
-    AlgoExecutionService<Bond> algo_execution_service;
-    AlgoExecutionServiceListener<Bond> algo_execution_listener(&algo_execution_service);
-    // Link the market data service to the algo execution listener
-    market_data_service.AddListener(&algo_execution_listener);
+    BondMarketDataService market_data_service;
+    BondAlgoExecutionService algo_execution_service;
+    AlgoExecutionServiceListener<Bond, BondAlgoExecutionService> algo_execution_listener(&algo_execution_service);
 
-    ExecutionService<Bond> execution_service;
-    ExecutionServiceListener<Bond> execution_listener(&execution_service);
+    HistoricalMarketDataService<Bond> historical_market_data_service;
+    HistoricalMarketDataListener<Bond> historical_market_data_listener(&historical_market_data_service);
+    AsyncServiceListener<OrderBook<Bond> > async_market_data_listener(&historical_market_data_listener);
+    // Link the market data service to the algo execution listener and the historical market data listener
+    market_data_service.GetListenerChain().Bind(&algo_execution_listener, &async_market_data_listener);
+    // Level updates reach the algo only when they can move the top of a book
+    AlgoExecutionUpdateListener<Bond, BondAlgoExecutionService> algo_execution_update_listener(&algo_execution_service);
+    market_data_service.AddUpdateListener(&algo_execution_update_listener);
+
+    BondExecutionService execution_service;
+    ExecutionServiceListener<Bond, BondExecutionService> execution_listener(&execution_service);
     // Link the algo execution service to the execution listener
-    algo_execution_service.AddListener(&execution_listener);
+    algo_execution_service.GetListenerChain().Bind(&execution_listener);
 
-    TradeBookingServiceListener<Bond> trade_booking_listener(&trade_booking_service);
-    // Link the execution service to the trade booking listener
-    execution_service.AddListener(&trade_booking_listener);
+    TradeBookingServiceListener<Bond, BondTradeBookingService> trade_booking_listener(&trade_booking_service);
 
     HistoricalExecutionService<Bond> historical_execution_service;
     HistoricalExecutionListener<Bond> historical_execution_listener(&historical_execution_service);
-    // Link the execution service to the historical execution listener
-    execution_service.AddListener(&historical_execution_listener);
+    AsyncServiceListener<ExecutionOrder<Bond> > async_execution_listener(&historical_execution_listener);
+    // Link the execution service to the trade booking listener and the historical execution listener
+    execution_service.GetListenerChain().Bind(&trade_booking_listener, &async_execution_listener);
 
     /*
     * Part (d). Process inquiry data from input/inquires.txt
@@ -131,16 +251,44 @@ int main()
     inquiry_service.AddListener(&historical_inquiry_listner);
 
 
-    // Fire up the system
-    TradeBookingConnector<Bond> trade_connector(&trade_booking_service);
-    PricingConnector<Bond> pricing_connector(&pricing_service);
-    MarketDataConnector<Bond> market_data_connector(&market_data_service);
+    // Fire up the system, each feed runs on its own thread.
+    // Parts (a) and (c) meet at the trade booking service, which serializes its callers.
+    TradeBookingConnector<Bond, BondTradeBookingService> trade_connector(&trade_booking_service);
+    PricingConnector<Bond, BondPricingService> pricing_connector(&pricing_service);
+    // The market data file is parsed on all cores, books still reach the service in file order
+    MarketDataConnector<Bond, BondMarketDataService> market_data_connector(&market_data_service, 512, thread::hardware_concurrency());
     InquiryConnector<Bond> inquiry_connector(&inquiry_service);
 
-    trade_connector.Subscribe("input/trades.txt");
-    pricing_connector.Subscribe("input/prices.txt");
-    market_data_connector.Subscribe("input/marketdata.txt");
-    inquiry_connector.Subscribe("input/inquiries.txt");
+    PipelineRunner runner;
+    if (synthetic)
+    {
+        runner.Add("trades", [&]() { trade_connector.SubscribeSynthetic(FeedOptions(synthetic_options, sizes.trades)); });
+        runner.Add("prices", [&]() { pricing_connector.SubscribeSynthetic(FeedOptions(synthetic_options, sizes.prices)); });
+        runner.Add("market data", [&]() { market_data_connector.SubscribeSynthetic(FeedOptions(synthetic_options, sizes.marketdata)); });
+        runner.Add("inquiries", [&]() { inquiry_connector.SubscribeSynthetic(FeedOptions(synthetic_options, sizes.inquiries)); });
+    }
+    else
+    {
+        runner.Add("trades", [&]() { trade_connector.Subscribe("input/trades.txt"); });
+        runner.Add("prices", [&]() { pricing_connector.Subscribe("input/prices.txt"); });
+        runner.Add("market data", [&]()
+        {
+            market_data_connector.Subscribe("input/marketdata.txt");
+            if (sizes.deltas > 0)
+                market_data_connector.SubscribeDeltas("input/marketdata_deltas.txt");
+        });
+        runner.Add("inquiries", [&]() { inquiry_connector.Subscribe("input/inquiries.txt"); });
+    }
+    runner.Run();
+
+    // Drain the asynchronous writers, then write out everything the output files still buffer
+    gui_service.Stop();
+    timer_service.Stop();
+    async_streaming_listener.Stop();
+    async_execution_listener.Stop();
+    async_market_data_listener.Stop();
+    OutputRegistry::Instance().Flush();
+    historical_market_data_service.Close();
 
     return 0;
 }
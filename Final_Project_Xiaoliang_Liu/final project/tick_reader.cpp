@@ -0,0 +1,68 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "TickPrice.hpp"
+#include "TickStore.hpp"
+
+using namespace std;
+
+/*
+* Reads the order book history the trading system keeps in output/marketdata.tick.
+* Without a product it lists the products of the store; with one it prints that product's
+* snapshots from a sequence number on, one per line: sequence, product, then price and quantity
+* of each bid level followed by each offer level.
+*
+* Usage: tick_reader output/marketdata.tick
+*        tick_reader output/marketdata.tick OTRUSTR_10Y [from_sequence [count]]
+*/
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2 || argc > 5)
+    {
+        cerr << "Usage: " << argv[0] << " <store> [product [from_sequence [count]]]\n";
+        return 1;
+    }
+    TickStoreReader store(argv[1]);
+    if (!store.IsOpen())
+    {
+        cerr << "ERROR: " << argv[1] << " is not a closed tick store.\n";
+        return 1;
+    }
+
+    if (argc == 2)
+    {
+        uint64_t total = 0;
+        for (uint32_t i = 0; i < store.GetProductCount(); ++i)
+        {
+            cout << store.GetProductId(i) << ", " << store.GetSnapshotCount(i) << " snapshots in "
+                << store.GetBlockCount(i) << " blocks\n";
+            total += store.GetSnapshotCount(i);
+        }
+        cout << total << " snapshots\n";
+        return 0;
+    }
+
+    uint32_t product;
+    if (!store.FindProduct(argv[2], product))
+    {
+        cerr << "ERROR: Product " << argv[2] << " is not in " << argv[1] << ".\n";
+        return 1;
+    }
+    uint64_t from_sequence = argc > 3 ? strtoull(argv[3], nullptr, 10) : 0;
+    uint64_t count = argc > 4 ? strtoull(argv[4], nullptr, 10) : UINT64_MAX;
+
+    TickStoreCursor cursor = store.Seek(product, from_sequence);
+    TickSnapshot snapshot;
+    for (uint64_t n = 0; n < count && cursor.Next(snapshot); ++n)
+    {
+        cout << snapshot.sequence << "," << store.GetProductId(product);
+        for (uint32_t i = 0; i < snapshot.bid_levels; ++i)
+            cout << "," << TickPrice(snapshot.bid_ticks[i]) << "," << snapshot.bid_quantities[i];
+        for (uint32_t i = 0; i < snapshot.offer_levels; ++i)
+            cout << "," << TickPrice(snapshot.offer_ticks[i]) << "," << snapshot.offer_quantities[i];
+        cout << '\n';
+    }
+    return 0;
+}